@@ -73,6 +73,9 @@ BOARD_HAVE_BLUETOOTH := true
 BOARD_HAVE_BLUETOOTH_BCM := true
 BOARD_BLUETOOTH_BDROID_BUILDCFG_INCLUDE_DIR := device/samsung/espressowifi/bluetooth
 
+# Sensors: compute the orientation sensor in the HAL instead of orientationd
+# BOARD_SENSORS_HAL_ORIENTATION := true
+
 # SELinux
 BOARD_SEPOLICY_DIRS += \
     device/samsung/espressowifi/sepolicy
@@ -90,8 +90,7 @@ PRODUCT_PACKAGES += \
     camera.omap4 \
     lights.omap4 \
     sensors.omap4 \
-    geomagneticd \
-    orientationd
+    geomagneticd
 
 # F2FS filesystem
 PRODUCT_PACKAGES += \
@@ -17,32 +17,24 @@
 #ifndef ANDROID_ACCELERATION_SENSOR_H
 #define ANDROID_ACCELERATION_SENSOR_H
 
-#include <stdint.h>
-#include <errno.h>
-#include <sys/cdefs.h>
-#include <sys/types.h>
-
 #include "sensors.h"
-#include "SensorBase.h"
-#include "InputEventReader.h"
-
-class AccelerationSensor : public SensorBase {
-    int mEnabled;
-    InputEventCircularReader mInputReader;
-    sensors_event_t mPendingEvent;
-    bool mHasPendingEvent;
-    char input_sysfs_path[PATH_MAX];
-    int input_sysfs_path_len;
-
-public:
-            AccelerationSensor();
-    virtual ~AccelerationSensor();
-    virtual int readEvents(sensors_event_t* data, int count);
-    virtual bool hasPendingEvents() const;
-    virtual int setDelay(int32_t handle, int64_t ns);
-    virtual int enable(int32_t handle, int enabled);
+#include "InputSensor.h"
+
+struct AccelerationTraits : ThreeAxisTraits {
+    static const char* inputName() { return "accelerometer"; }
+
+    enum {
+        handle = ID_A,
+        sensorType = SENSOR_TYPE_ACCELEROMETER,
+    };
+
+    constexpr float convert(int value) const {
+        return value * (GRAVITY_EARTH / 256.0f);
+    }
 };
 
+typedef InputSensor<AccelerationTraits> AccelerationSensor;
+
 /*****************************************************************************/
 
 #endif  // ANDROID_ACCELERATION_SENSOR_H
@@ -18,28 +18,60 @@ LOCAL_PATH := $(call my-dir)
 
 LIBSENSORS_PATH := $(LOCAL_PATH)
 
+LIBSENSORS_SRC_FILES := \
+	sensors.cpp \
+	InputEventReader.cpp \
+	SensorBase.cpp \
+	SensorBackend.cpp \
+	SimulatedBackend.cpp \
+	SensorEventFifo.cpp \
+	SensorFusion.cpp \
+	DeviceOrientation.cpp \
+	SensorStats.cpp \
+	SensorTrace.cpp \
+	DirectChannel.cpp \
+	TimestampFilter.cpp \
+	InputSensor.cpp \
+	LightSensor.cpp
+
+# Compute the orientation sensor in the HAL instead of orientationd
+ifeq ($(BOARD_SENSORS_HAL_ORIENTATION),true)
+LIBSENSORS_CFLAGS := -DSENSORS_HAL_ORIENTATION
+else
+LIBSENSORS_CFLAGS :=
+endif
+
+# Input device discovery, shared by the HAL and the daemons
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := input_index.c
+
+LOCAL_CFLAGS := -Wall -Werror
+
+LOCAL_MODULE := libsensors_input_index
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_STATIC_LIBRARY)
+
 # HAL module implemenation stored in
 # hw/<SENSORS_HARDWARE_MODULE_ID>.<ro.product.board>.so
 include $(CLEAR_VARS)
 
-LOCAL_SRC_FILES := \
-	sensors.cpp \
-	InputEventReader.cpp \
-	SensorBase.cpp \
-	AccelerationSensor.cpp \
-	LightSensor.cpp \
-	MagneticSensor.cpp \
-	OrientationSensor.cpp \
-	ProximitySensor.cpp
+LOCAL_SRC_FILES := $(LIBSENSORS_SRC_FILES)
 
 LOCAL_C_INCLUDES := \
 	$(LIBSENSORS_PATH)
 
-LOCAL_CFLAGS := -Wall -Werror
+LOCAL_CFLAGS := -Wall -Werror $(LIBSENSORS_CFLAGS)
 
 LOCAL_SHARED_LIBRARIES := libutils libcutils liblog libhardware
+LOCAL_STATIC_LIBRARIES := libsensors_input_index
 LOCAL_PRELINK_MODULE := false
 
+ifneq ($(BOARD_SENSORS_HAL_ORIENTATION),true)
+LOCAL_REQUIRED_MODULES := orientationd
+endif
+
 LOCAL_MODULE := sensors.omap4
 LOCAL_MODULE_RELATIVE_PATH := hw
 LOCAL_MODULE_TAGS := optional
@@ -51,12 +83,15 @@ LOCAL_PATH := $(LIBSENSORS_PATH)/geomagneticd
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
-	geomagneticd.c \
-	input.c
+	geomagneticd.c
+
+LOCAL_C_INCLUDES := \
+	$(LIBSENSORS_PATH)
 
 LOCAL_CFLAGS := -Wall -Werror
 
 LOCAL_SHARED_LIBRARIES := libutils libcutils liblog
+LOCAL_STATIC_LIBRARIES := libsensors_input_index
 LOCAL_PRELINK_MODULE := false
 
 LOCAL_MODULE := geomagneticd
@@ -70,16 +105,124 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
 	orientationd.c \
+	orientation.c \
+	filter.c \
 	input.c \
+	history.c \
 	bma250.c \
 	yas530.c
 
+LOCAL_C_INCLUDES := \
+	$(LIBSENSORS_PATH)
+
 LOCAL_CFLAGS := -Wall -Werror
+LOCAL_ARM_NEON := true
 
 LOCAL_SHARED_LIBRARIES := libutils libcutils liblog
+LOCAL_STATIC_LIBRARIES := libsensors_input_index
 LOCAL_PRELINK_MODULE := false
 
 LOCAL_MODULE := orientationd
 LOCAL_MODULE_TAGS := optional
+LOCAL_INIT_RC := orientationd.rc
+
+include $(BUILD_EXECUTABLE)
+
+# Speed and accuracy of the orientation computations, on the tablet and
+# on the host
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	orientation.c \
+	orientationbench.c
+
+LOCAL_C_INCLUDES := \
+	$(LIBSENSORS_PATH)
+
+LOCAL_CFLAGS := -Wall -Werror -O2
+LOCAL_ARM_NEON := true
+
+LOCAL_MODULE := orientationbench
+LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	orientation.c \
+	orientationbench.c
+
+LOCAL_C_INCLUDES := \
+	$(LIBSENSORS_PATH) \
+	hardware/libhardware/include
+
+LOCAL_CFLAGS := -Wall -Werror -O2
+
+LOCAL_MODULE := orientationbench
+LOCAL_MODULE_HOST_OS := linux
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Record/replay benchmark, the HAL sources are built into it. The target
+# build records the sensor input devices, the host build replays them.
+LOCAL_PATH := $(LIBSENSORS_PATH)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	$(LIBSENSORS_SRC_FILES) \
+	sensorsbench/sensorsbench.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LIBSENSORS_PATH)
+
+LOCAL_CFLAGS := -Wall -Werror $(LIBSENSORS_CFLAGS)
+
+LOCAL_SHARED_LIBRARIES := libutils libcutils liblog
+LOCAL_STATIC_LIBRARIES := libsensors_input_index
+
+LOCAL_MODULE := sensorsbench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := input_index.c
+
+LOCAL_CFLAGS := -Wall -Werror \
+	-DINPUT_SYSFS_PATH=\"/tmp/sensorsbench/sysfs/\"
+
+LOCAL_MODULE := libsensors_input_index_bench
+LOCAL_MODULE_HOST_OS := linux
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+	$(LIBSENSORS_SRC_FILES) \
+	sensorsbench/sensorsbench.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LIBSENSORS_PATH) \
+	hardware/libhardware/include
+
+LOCAL_CFLAGS := -Wall -Werror $(LIBSENSORS_CFLAGS) \
+	-DSENSORSBENCH_ROOT=\"/tmp/sensorsbench\" \
+	-DDEVICE_VARIANT_SYSFS=\"/tmp/sensorsbench/board_type\" \
+	-DINPUT_SYSFS_PATH=\"/tmp/sensorsbench/sysfs/\" \
+	-DSENSORS_STATS_FILE=\"/tmp/sensorsbench/stats\" \
+	-DSENSORS_SIM_ROOT=\"/tmp/sensorsbench/sim\"
+
+LOCAL_SHARED_LIBRARIES := libutils libcutils liblog
+LOCAL_STATIC_LIBRARIES := libsensors_input_index_bench
+
+LOCAL_MODULE := sensorsbench
+LOCAL_MODULE_HOST_OS := linux
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
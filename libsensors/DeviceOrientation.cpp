@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "DeviceOrientation"
+
+#include <math.h>
+#include <stdlib.h>
+#include <cstring>
+
+#include <cutils/log.h>
+
+#include "DeviceOrientation.h"
+
+/*****************************************************************************/
+
+// Low-pass time constant of the gravity estimate, in seconds
+#define FILTER_TIME_CONSTANT    0.2f
+
+// Longest gap between samples still considered continuous, in ns
+#define MAX_SAMPLE_GAP          1000000000LL
+
+// How long a proposal must hold before it is reported, in ns
+#define SETTLE_TIME             300000000LL
+
+// Deviation from 1 g above which the device is taken as being moved
+#define ACCELERATION_TOLERANCE  4.0f
+
+// Degrees past a bucket boundary the angle must go to leave the current
+// rotation
+#define ANGLE_HYSTERESIS        22
+
+#define RADIANS_TO_DEGREES      (180.0f / float(M_PI))
+
+// Tilt range, in degrees from vertical, each rotation is proposed in.
+// Positive tilts face the sky, the screen becomes hard to read sooner
+// when it is upside down.
+static const int sTiltTolerance[4][2] = {
+    { -25, 70 },
+    { -25, 65 },
+    { -25, 60 },
+    { -25, 65 },
+};
+
+DeviceOrientation::DeviceOrientation()
+    : mOffset(0)
+{
+    reset();
+}
+
+void DeviceOrientation::reset()
+{
+    memset(mGravity, 0, sizeof(mGravity));
+    mTimestamp = 0;
+    mProposalTime = 0;
+    mProposal = -1;
+    mRotation = -1;
+}
+
+/*
+ * Rotation the filtered gravity vector points to, -1 when there is no
+ * clear one. Same conventions as WindowOrientationListener: the angle
+ * runs clockwise from the device y axis.
+ */
+int DeviceOrientation::propose(const float g[3]) const
+{
+    float magnitude = sqrtf(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+    if (fabsf(magnitude - GRAVITY_EARTH) > ACCELERATION_TOLERANCE)
+        return -1;
+
+    int tilt = int(roundf(asinf(g[2] / magnitude) * RADIANS_TO_DEGREES));
+    int angle = int(roundf(-atan2f(-g[0], g[1]) * RADIANS_TO_DEGREES));
+    if (angle < 0)
+        angle += 360;
+
+    int rotation = ((angle + 45) / 90) & 3;
+    if (tilt < sTiltTolerance[rotation][0] || tilt > sTiltTolerance[rotation][1])
+        return -1;
+
+    // leaving the current rotation takes more than crossing the boundary
+    if (mRotation >= 0 && rotation != (mRotation + mOffset) % 4) {
+        int distance = abs(angle - rotation * 90);
+        if (distance > 180)
+            distance = 360 - distance;
+        if (distance > 45 - ANGLE_HYSTERESIS)
+            return -1;
+    }
+
+    return rotation;
+}
+
+bool DeviceOrientation::handleAcceleration(const sensors_vec_t& acceleration,
+        int64_t timestamp)
+{
+    // restart the filter and the proposal after a gap, the rotation stays
+    if (!mTimestamp || timestamp <= mTimestamp || timestamp - mTimestamp > MAX_SAMPLE_GAP) {
+        memcpy(mGravity, acceleration.v, sizeof(mGravity));
+        mProposal = -1;
+    } else {
+        float dt = (timestamp - mTimestamp) * 1e-9f;
+        float k = dt / (FILTER_TIME_CONSTANT + dt);
+        for (int i = 0; i < 3; i++)
+            mGravity[i] += k * (acceleration.v[i] - mGravity[i]);
+    }
+    mTimestamp = timestamp;
+
+    int proposal = propose(mGravity);
+    if (proposal != mProposal) {
+        mProposal = proposal;
+        mProposalTime = timestamp;
+    }
+
+    if (mProposal < 0 || timestamp - mProposalTime < SETTLE_TIME)
+        return false;
+
+    int rotation = (mProposal + 4 - mOffset) % 4;
+    if (rotation == mRotation)
+        return false;
+
+    ALOGV("rotation %d -> %d", mRotation, rotation);
+    mRotation = rotation;
+    return true;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_DEVICE_ORIENTATION_H
+#define ANDROID_DEVICE_ORIENTATION_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+
+/*****************************************************************************/
+
+/*
+ * Screen rotation the device is held in, for the device orientation
+ * sensor: 0 to 3 quarter turns counterclockwise from the natural
+ * orientation, like Surface.ROTATION_*. This is the accelerometer judge
+ * of the framework's WindowOrientationListener moved into the HAL, so
+ * that system_server only hears about actual rotations.
+ *
+ * A rotation is proposed while the device is neither accelerating nor
+ * lying too flat for it, and once the angle is well past the bucket
+ * boundary of the current rotation. It is reported when the proposal
+ * held for the settle time.
+ */
+class DeviceOrientation
+{
+    float mGravity[3];
+    int64_t mTimestamp;
+    int64_t mProposalTime;
+    int mProposal;
+    int mRotation;
+    int mOffset;
+
+    int propose(const float g[3]) const;
+
+public:
+    DeviceOrientation();
+    // forget the rotation, the device may have turned since
+    void reset();
+
+    // quarter turns the judged rotation is turned back by, for
+    // accelerometer axes that follow the panel rather than the display
+    void setOffset(int quarterTurns) { mOffset = quarterTurns & 3; }
+
+    // true when the sample settled a new rotation
+    bool handleAcceleration(const sensors_vec_t& acceleration, int64_t timestamp);
+
+    // current rotation, -1 until one settled
+    int getRotation() const { return mRotation; }
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_DEVICE_ORIENTATION_H
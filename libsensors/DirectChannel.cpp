@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "DirectChannel"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <cstring>
+
+#include <cutils/log.h>
+
+#include "DirectChannel.h"
+
+/*****************************************************************************/
+
+DirectChannel::DirectChannel()
+    : mBuffer(NULL),
+    mMapSize(0),
+    mSize(0),
+    mNext(0),
+    mCounter(0)
+{
+    memset(mPeriod, 0, sizeof(mPeriod));
+    memset(mLastEvent, 0, sizeof(mLastEvent));
+}
+
+DirectChannel::~DirectChannel()
+{
+    if (mBuffer)
+        munmap(mBuffer, mMapSize);
+}
+
+int DirectChannel::init(int fd, size_t size)
+{
+    if (fd < 0 || size < sizeof(sensors_event_t))
+        return -EINVAL;
+
+    void* buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buffer == MAP_FAILED) {
+        ALOGE("couldn't map direct channel (%s)", strerror(errno));
+        return -errno;
+    }
+
+    memset(buffer, 0, size);
+    mBuffer = static_cast<sensors_event_t*>(buffer);
+    mMapSize = size;
+    mSize = size / sizeof(sensors_event_t);
+    return 0;
+}
+
+void DirectChannel::setPeriod(int handle, int64_t ns)
+{
+    mPeriod[handle] = ns;
+    mLastEvent[handle] = 0;
+}
+
+void DirectChannel::write(const sensors_event_t& event, int token)
+{
+    const int handle = event.sensor;
+    const int64_t period = mPeriod[handle];
+
+    if (!period)
+        return;
+
+    // the sensor may run faster for another client, keep this channel
+    // at its own rate
+    if (mLastEvent[handle] &&
+            event.timestamp - mLastEvent[handle] < period - period / DECIMATION_SLACK)
+        return;
+    mLastEvent[handle] = event.timestamp;
+
+    sensors_event_t* const record(&mBuffer[mNext]);
+    mNext = (mNext + 1) % mSize;
+
+    // the counter never goes back to 0, which marks an unwritten record
+    if (++mCounter == 0)
+        mCounter = 1;
+
+    // invalidate the record while it is rewritten, then publish it
+    __atomic_store_n(&record->reserved0, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    record->version = sizeof(sensors_event_t);
+    record->sensor = token;
+    record->type = event.type;
+    record->timestamp = event.timestamp;
+    memcpy(record->data, event.data, sizeof(record->data));
+    __atomic_store_n(&record->reserved0, int32_t(mCounter), __ATOMIC_RELEASE);
+}
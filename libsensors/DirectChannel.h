@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_DIRECT_CHANNEL_H
+#define ANDROID_DIRECT_CHANNEL_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+
+/*****************************************************************************/
+
+/*
+ * Shared memory ring a client registered for direct reports. Events are
+ * written in the SENSOR_DIRECT_FMT_SENSORS_EVENT layout: sensors_event_t
+ * records whose version holds the record size, sensor the report token
+ * and reserved0 an atomic counter, stored last, that tells the reader the
+ * record is complete. The ring is only written by the poll thread.
+ */
+class DirectChannel
+{
+    sensors_event_t* mBuffer;
+    size_t mMapSize;
+    size_t mSize;
+    size_t mNext;
+    uint32_t mCounter;
+
+    // sampling period of each handle, 0 when not reported
+    int64_t mPeriod[ID_MAX];
+    int64_t mLastEvent[ID_MAX];
+
+public:
+    DirectChannel();
+    ~DirectChannel();
+
+    // map the first size bytes of a shared memory fd
+    int init(int fd, size_t size);
+
+    int64_t period(int handle) const { return mPeriod[handle]; }
+    void setPeriod(int handle, int64_t ns);
+
+    // copy an event to the ring if the handle is due, token is its
+    // report token
+    void write(const sensors_event_t& event, int token);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_DIRECT_CHANNEL_H
@@ -28,62 +28,95 @@
 #include <cutils/log.h>
 
 #include "InputEventReader.h"
+#include "SensorTrace.h"
 
 /*****************************************************************************/
 
 struct input_event;
 
-InputEventCircularReader::InputEventCircularReader(size_t numEvents)
-    : mBuffer(new input_event[numEvents * 2]),
-      mBufferEnd(mBuffer + numEvents),
-      mHead(mBuffer),
-      mCurr(mBuffer),
-      mFreeSpace(numEvents)
+InputEventReader::InputEventReader(size_t numEvents)
+    : mBuffer(new input_event[numEvents]),
+      mSize(numEvents),
+      mHead(0),
+      mTail(0),
+      mTrace(NULL),
+      mTraceDevice(-1)
 {
 }
 
-InputEventCircularReader::~InputEventCircularReader()
+InputEventReader::~InputEventReader()
 {
     delete [] mBuffer;
 }
 
-ssize_t InputEventCircularReader::fill(int fd)
+size_t InputEventReader::capacityFor(size_t eventsPerFrame,
+        int64_t minDelayNs)
 {
-    size_t numEventsRead = 0;
-    if (mFreeSpace) {
-        const ssize_t nread = read(fd, mHead, mFreeSpace * sizeof(input_event));
-        if (nread<0 || nread % sizeof(input_event)) {
-            // we got a partial event!!
-            return nread<0 ? -errno : -EINVAL;
-        }
-
-        numEventsRead = nread / sizeof(input_event);
-        if (numEventsRead) {
-            mHead += numEventsRead;
-            mFreeSpace -= numEventsRead;
-            if (mHead > mBufferEnd) {
-                size_t s = mHead - mBufferEnd;
-                memcpy(mBuffer, mBufferEnd, s * sizeof(input_event));
-                mHead = mBuffer + s;
-            }
-        }
+    int64_t frames = minDelayNs > 0 ? INPUT_READER_WINDOW_NS / minDelayNs : 1;
+    if (frames < 1)
+        frames = 1;
+
+    return eventsPerFrame * frames;
+}
+
+ssize_t InputEventReader::fill(int fd)
+{
+    // keep what was not consumed yet (usually a partial frame) in front
+    if (mHead) {
+        memmove(mBuffer, mBuffer + mHead, (mTail - mHead) * sizeof(input_event));
+        mTail -= mHead;
+        mHead = 0;
+    }
+
+    if (mTail == mSize) {
+        // decode what we already have before reading more
+        input_event const* events;
+        if (readFrame(&events))
+            return 0;
+
+        // a frame that doesn't fit would block the reader forever
+        ALOGE("input buffer overrun, dropping %zu events", mTail);
+        mTail = 0;
+    }
+
+    // a single read drains everything the driver has queued that fits
+    const ssize_t nread = read(fd, mBuffer + mTail, (mSize - mTail) * sizeof(input_event));
+    if (nread < 0)
+        return errno == EAGAIN ? 0 : -errno;
+    if (nread % sizeof(input_event)) {
+        // we got a partial event!!
+        return -EINVAL;
     }
 
+    size_t numEventsRead = nread / sizeof(input_event);
+    if (mTrace)
+        mTrace->write(mTraceDevice, mBuffer + mTail, numEventsRead);
+    mTail += numEventsRead;
+
     return numEventsRead;
 }
 
-ssize_t InputEventCircularReader::readEvent(input_event const** events)
+ssize_t InputEventReader::readFrame(input_event const** events) const
+{
+    *events = mBuffer + mHead;
+    for (size_t i = mHead; i < mTail; i++) {
+        if (mBuffer[i].type == EV_SYN)
+            return i - mHead + 1;
+    }
+
+    // no complete frame yet
+    return 0;
+}
+
+void InputEventReader::consume(size_t numEvents)
 {
-    *events = mCurr;
-    ssize_t available = (mBufferEnd - mBuffer) - mFreeSpace;
-    return available ? 1 : 0;
+    mHead += numEvents;
+    if (mHead >= mTail)
+        mHead = mTail = 0;
 }
 
-void InputEventCircularReader::next()
+void InputEventReader::setTrace(SensorTraceWriter* trace, int device)
 {
-    mCurr++;
-    mFreeSpace++;
-    if (mCurr >= mBufferEnd) {
-        mCurr = mBuffer;
-    }
+    mTrace = trace;
+    mTraceDevice = device;
 }
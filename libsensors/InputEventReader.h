@@ -24,22 +24,40 @@
 
 /*****************************************************************************/
 
+/* Longest stretch the poll thread is expected to leave an fd unread */
+#define INPUT_READER_WINDOW_NS (200000000LL)
+
 struct input_event;
+class SensorTraceWriter;
 
-class InputEventCircularReader
+/*
+ * Buffers the events read from an evdev fd so that they can be decoded one
+ * EV_SYN-delimited frame at a time. Unread events are moved back to the
+ * start of the buffer before each fill(), which keeps every frame in one
+ * contiguous span without any wraparound copy.
+ */
+class InputEventReader
 {
     struct input_event* const mBuffer;
-    struct input_event* const mBufferEnd;
-    struct input_event* mHead;
-    struct input_event* mCurr;
-    ssize_t mFreeSpace;
+    const size_t mSize;
+    size_t mHead;
+    size_t mTail;
+    SensorTraceWriter* mTrace;
+    int mTraceDevice;
 
 public:
-    InputEventCircularReader(size_t numEvents);
-    ~InputEventCircularReader();
+    InputEventReader(size_t numEvents);
+    ~InputEventReader();
     ssize_t fill(int fd);
-    ssize_t readEvent(input_event const** events);
-    void next();
+    ssize_t readFrame(input_event const** events) const;
+    void consume(size_t numEvents);
+
+    // record everything fill() reads as the given trace device
+    void setTrace(SensorTraceWriter* trace, int device);
+
+    // Room for everything a sensor reporting frames of eventsPerFrame
+    // events every minDelayNs produces within INPUT_READER_WINDOW_NS
+    static size_t capacityFor(size_t eventsPerFrame, int64_t minDelayNs);
 };
 
 /*****************************************************************************/
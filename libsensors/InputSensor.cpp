@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2013 Paul Kocialkowski <contact@paulk.fr>
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputSensor"
+
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <cstring>
+
+#include <cutils/log.h>
+
+#include "InputSensor.h"
+#include "SensorStats.h"
+#include "AccelerationSensor.h"
+#include "LightSensor.h"
+#include "MagneticSensor.h"
+#include "OrientationSensor.h"
+#include "ProximitySensor.h"
+#include "SensorTrace.h"
+
+template <class Traits>
+InputSensor<Traits>::InputSensor(const Traits& traits)
+    : SensorBase(NULL, Traits::inputName()),
+    mTraits(traits),
+    mEnabled(0),
+    mInputReader(InputEventReader::capacityFor(Traits::eventsPerFrame,
+            Traits::minDelay)),
+    mHasPendingEvent(false),
+    mHasReportedEvent(false)
+{
+    mPendingEvent.version = sizeof(sensors_event_t);
+    mPendingEvent.sensor = Traits::handle;
+    mPendingEvent.type = Traits::sensorType;
+    memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
+
+    if (data_fd >= 0) {
+        openSysfsAttribute(mEnableAttr, "enable");
+        if (Traits::delayAttribute())
+            openSysfsAttribute(mDelayAttr, Traits::delayAttribute());
+        // stay powered down until a client shows up
+        mEnableAttr.write(0);
+
+        SensorTraceWriter* trace = SensorTraceWriter::get();
+        int device = trace ? trace->addDevice(Traits::inputName()) : -1;
+        if (device >= 0)
+            mInputReader.setTrace(trace, device);
+    }
+}
+
+template <class Traits>
+InputSensor<Traits>::~InputSensor() {
+    if (mEnabled) {
+        enable(0, 0);
+    }
+}
+
+template <class Traits>
+void InputSensor<Traits>::setInitialState()
+{
+    struct input_absinfo absinfo;
+
+    if (Traits::initialStateCode < 0)
+        return;
+
+    if (!ioctl(data_fd, EVIOCGABS(Traits::initialStateCode), &absinfo)) {
+        // make sure to report an event immediately
+        mHasPendingEvent = true;
+        mPendingEvent.data[Traits::axis(Traits::initialStateCode)] =
+                mTraits.convert(absinfo.value);
+    }
+}
+
+template <class Traits>
+int InputSensor<Traits>::setDelay(int32_t handle __unused, int64_t ns)
+{
+    if (!Traits::delayAttribute())
+        return 0;
+
+    // the sample period is about to change
+    mTimestampFilter.reset();
+
+    return mDelayAttr.write(Traits::delayValue(ns)) < 0 ? -1 : 0;
+}
+
+template <class Traits>
+int InputSensor<Traits>::enable(int32_t handle __unused, int en)
+{
+    int flags = en ? 1 : 0;
+    if (flags != mEnabled) {
+        if (mEnableAttr.write(flags) < 0)
+            return -1;
+        mEnabled = flags;
+        mHasReportedEvent = false;
+        mTimestampFilter.reset();
+        setInitialState();
+    }
+    return 0;
+}
+
+/*
+ * Whether the decoded sample goes to the framework, on-change sensors
+ * skip the ones too close to the last reported value
+ */
+template <class Traits>
+bool InputSensor<Traits>::report()
+{
+    if (!mEnabled) {
+        SensorStats::count(Traits::handle, SensorStats::EVENTS_DISABLED);
+        return false;
+    }
+
+    if (mHasReportedEvent && !mTraits.changed(mReportedEvent, mPendingEvent)) {
+        SensorStats::count(Traits::handle, SensorStats::EVENTS_UNCHANGED);
+        return false;
+    }
+
+    mReportedEvent = mPendingEvent;
+    mHasReportedEvent = true;
+    return true;
+}
+
+template <class Traits>
+bool InputSensor<Traits>::hasPendingEvents() const {
+    return mHasPendingEvent;
+}
+
+template <class Traits>
+int InputSensor<Traits>::readEvents(sensors_event_t* data, int count)
+{
+    if (count < 1)
+        return -EINVAL;
+
+    if (mHasPendingEvent) {
+        mHasPendingEvent = false;
+        mPendingEvent.timestamp = getTimestamp();
+        *data = mPendingEvent;
+        return report() ? 1 : 0;
+    }
+
+    ssize_t n = mInputReader.fill(data_fd);
+    if (n < 0) {
+        SensorStats::count(Traits::handle, SensorStats::FILL_ERRORS);
+        return n;
+    }
+
+    int numEventReceived = 0;
+    int numFrames = 0;
+    int64_t clockOffset = inputClockOffset();
+    input_event const* event;
+    ssize_t frame;
+
+    while (count && (frame = mInputReader.readFrame(&event)) > 0) {
+        // everything up to the trailing EV_SYN updates the pending event
+        for (input_event const* end = event + frame - 1; event < end; event++) {
+            if (event->type == Traits::eventType) {
+                int axis = Traits::axis(event->code);
+                if (axis >= 0)
+                    mPendingEvent.data[axis] = mTraits.convert(event->value);
+            } else {
+                SensorStats::count(Traits::handle, SensorStats::UNKNOWN_EVENTS);
+                ALOGE("unknown event (type=%d, code=%d, value=%d)",
+                        event->type, event->code, event->value);
+            }
+        }
+
+        mPendingEvent.timestamp = timevalToNano(event->time) + clockOffset;
+        if (Traits::smoothTimestamps)
+            mPendingEvent.timestamp = mTimestampFilter.filter(mPendingEvent.timestamp);
+        numFrames++;
+        if (report()) {
+            *data++ = mPendingEvent;
+            count--;
+            numEventReceived++;
+        }
+        mInputReader.consume(frame);
+    }
+
+    SensorStats::count(Traits::handle, SensorStats::EVENTS_DECODED, numFrames);
+    return numEventReceived;
+}
+
+template class InputSensor<AccelerationTraits>;
+template class InputSensor<LightTraits>;
+template class InputSensor<MagneticTraits>;
+template class InputSensor<OrientationTraits>;
+template class InputSensor<ProximityTraits>;
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INPUT_SENSOR_H
+#define ANDROID_INPUT_SENSOR_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+#include "SensorBase.h"
+#include "InputEventReader.h"
+#include "TimestampFilter.h"
+
+/*****************************************************************************/
+
+/*
+ * Sensor backed by an evdev input device and its enable/delay sysfs
+ * attributes. Everything that differs between sensors comes from Traits:
+ *
+ *   inputName()        input device name, as reported by EVIOCGNAME
+ *   delayAttribute()   sysfs attribute taking the rate, NULL if none
+ *   handle             sensor handle (ID_*)
+ *   sensorType         SENSOR_TYPE_*
+ *   eventType          evdev type carrying the values (EV_ABS, EV_REL)
+ *   eventsPerFrame     events per sample, EV_SYN included
+ *   initialStateCode   ABS code reported right after enable, -1 if none
+ *   smoothTimestamps   1 for periodic sensors whose timestamps are filtered
+ *   minDelay           fastest sampling period in ns
+ *   axis(code)         index in sensors_event_t.data of an event code
+ *   delayValue(ns)     value written to the delay attribute
+ *   convert(value)     raw value to SI units
+ *   changed(last, event) whether a sample differs enough from the last
+ *                      reported one to be reported
+ *
+ * Member functions are defined in InputSensor.cpp, which instantiates the
+ * template for every sensor.
+ */
+template <class Traits>
+class InputSensor : public SensorBase {
+    Traits mTraits;
+    int mEnabled;
+    InputEventReader mInputReader;
+    sensors_event_t mPendingEvent;
+    bool mHasPendingEvent;
+    sensors_event_t mReportedEvent;
+    bool mHasReportedEvent;
+    TimestampFilter mTimestampFilter;
+    SysfsAttribute mEnableAttr;
+    SysfsAttribute mDelayAttr;
+
+    void setInitialState();
+    bool report();
+
+public:
+            InputSensor(const Traits& traits = Traits());
+    virtual ~InputSensor();
+    virtual int readEvents(sensors_event_t* data, int count);
+    virtual bool hasPendingEvents() const;
+    virtual int setDelay(int32_t handle, int64_t ns);
+    virtual int enable(int32_t handle, int enabled);
+};
+
+/*
+ * Three axis sensors reporting ABS_X/Y/Z and taking their rate in ms
+ */
+struct ThreeAxisTraits {
+    static const char* delayAttribute() { return "delay"; }
+
+    enum {
+        eventType = EV_ABS,
+        eventsPerFrame = 4,
+        initialStateCode = -1,
+        smoothTimestamps = 1,
+    };
+
+    static const int64_t minDelay = 10000000;
+
+    static constexpr int axis(int code) {
+        return code == ABS_X ? 0 : code == ABS_Y ? 1 : code == ABS_Z ? 2 : -1;
+    }
+
+    static constexpr int64_t delayValue(int64_t ns) {
+        return ns < 10000000 ? 10 : ns / 1000000;
+    }
+
+    static constexpr bool changed(const sensors_event_t&, const sensors_event_t&) {
+        return true;
+    }
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_INPUT_SENSOR_H
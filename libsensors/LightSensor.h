@@ -17,35 +17,58 @@
 #ifndef ANDROID_LIGHT_SENSOR_H
 #define ANDROID_LIGHT_SENSOR_H
 
-#include <stdint.h>
-#include <errno.h>
-#include <sys/cdefs.h>
-#include <sys/types.h>
-
 #include "sensors.h"
-#include "SensorBase.h"
-#include "InputEventReader.h"
+#include "InputSensor.h"
+
+/*
+ * A new lux value is only reported when it differs from the last one by
+ * more than either LIGHT_HYSTERESIS_LUX or LIGHT_HYSTERESIS_RATIO of it,
+ * or when it goes to or from darkness (0 lux)
+ */
+#ifndef LIGHT_HYSTERESIS_LUX
+#define LIGHT_HYSTERESIS_LUX    1.0f
+#endif
 
-class LightSensor : public SensorBase {
+#ifndef LIGHT_HYSTERESIS_RATIO
+#define LIGHT_HYSTERESIS_RATIO  0.05f
+#endif
+
+struct LightTraits {
     int mSensorType;
-    int mEnabled;
-    InputEventCircularReader mInputReader;
-    sensors_event_t mPendingEvent;
-    bool mHasPendingEvent;
-    char input_sysfs_path[PATH_MAX];
-    int input_sysfs_path_len;
-
-    float valueToLux(int value) const;
-
-public:
-            LightSensor(const int sensorType);
-    virtual ~LightSensor();
-    virtual int readEvents(sensors_event_t* data, int count);
-    virtual bool hasPendingEvents() const;
-    virtual int setDelay(int32_t handle, int64_t ns);
-    virtual int enable(int32_t handle, int enabled);
+    // raw ADC value to lux, NULL for linear sensors
+    const float* mLuxTable;
+    int mLuxTableSize;
+
+    LightTraits(int sensorType);
+
+    static const char* inputName() { return "light_sensor"; }
+    static const char* delayAttribute() { return "poll_delay"; }
+
+    enum {
+        handle = ID_L,
+        sensorType = SENSOR_TYPE_LIGHT,
+        eventType = EV_REL,
+        eventsPerFrame = 2,
+        initialStateCode = -1,
+        smoothTimestamps = 0,
+    };
+
+    static const int64_t minDelay = 10000000;
+
+    static constexpr int axis(int code) {
+        return code == EVENT_TYPE_LIGHT ? 0 : -1;
+    }
+
+    static constexpr int64_t delayValue(int64_t ns) {
+        return ns;
+    }
+
+    float convert(int value) const;
+    bool changed(const sensors_event_t& last, const sensors_event_t& event) const;
 };
 
+typedef InputSensor<LightTraits> LightSensor;
+
 /*****************************************************************************/
 
 #endif  // ANDROID_LIGHT_SENSOR_H
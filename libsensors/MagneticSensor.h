@@ -17,32 +17,24 @@
 #ifndef ANDROID_MAGNETIC_SENSOR_H
 #define ANDROID_MAGNETIC_SENSOR_H
 
-#include <stdint.h>
-#include <errno.h>
-#include <sys/cdefs.h>
-#include <sys/types.h>
-
 #include "sensors.h"
-#include "SensorBase.h"
-#include "InputEventReader.h"
-
-class MagneticSensor : public SensorBase {
-    int mEnabled;
-    InputEventCircularReader mInputReader;
-    sensors_event_t mPendingEvent;
-    bool mHasPendingEvent;
-    char input_sysfs_path[PATH_MAX];
-    int input_sysfs_path_len;
-
-public:
-            MagneticSensor();
-    virtual ~MagneticSensor();
-    virtual int readEvents(sensors_event_t* data, int count);
-    virtual bool hasPendingEvents() const;
-    virtual int setDelay(int32_t handle, int64_t ns);
-    virtual int enable(int32_t handle, int enabled);
+#include "InputSensor.h"
+
+struct MagneticTraits : ThreeAxisTraits {
+    static const char* inputName() { return "geomagnetic"; }
+
+    enum {
+        handle = ID_M,
+        sensorType = SENSOR_TYPE_MAGNETIC_FIELD,
+    };
+
+    constexpr float convert(int value) const {
+        return value / 1000.0f;
+    }
 };
 
+typedef InputSensor<MagneticTraits> MagneticSensor;
+
 /*****************************************************************************/
 
 #endif  // ANDROID_MAGNETIC_SENSOR_H
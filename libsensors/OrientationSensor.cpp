@@ -1,150 +0,0 @@
-/*
- * Copyright (C) 2013 Paul Kocialkowski <contact@paulk.fr>
- * Copyright (C) 2016 The Android Open Source Project
- *
- * Licensed under the Apache License, Version 2.0 (the "License");
- * you may not use this file except in compliance with the License.
- * You may obtain a copy of the License at
- *
- *      http://www.apache.org/licenses/LICENSE-2.0
- *
- * Unless required by applicable law or agreed to in writing, software
- * distributed under the License is distributed on an "AS IS" BASIS,
- * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
- * See the License for the specific language governing permissions and
- * limitations under the License.
- */
-
-#define LOG_TAG "OrientationSensor"
-
-#include <fcntl.h>
-#include <errno.h>
-#include <math.h>
-#include <poll.h>
-#include <unistd.h>
-#include <dirent.h>
-#include <sys/select.h>
-#include <cstring>
-
-#include <cutils/log.h>
-
-#include "OrientationSensor.h"
-
-OrientationSensor::OrientationSensor()
-    : SensorBase(NULL, "orientation"),
-    mEnabled(0),
-    mInputReader(4),
-    mHasPendingEvent(false)
-{
-    mPendingEvent.version = sizeof(sensors_event_t);
-    mPendingEvent.sensor = ID_O;
-    mPendingEvent.type = SENSOR_TYPE_ORIENTATION;
-    memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
-
-    if (data_fd) {
-        strcpy(input_sysfs_path, "/sys/class/input/");
-        strcat(input_sysfs_path, input_name);
-        strcat(input_sysfs_path, "/device/");
-        input_sysfs_path_len = strlen(input_sysfs_path);
-        enable(0, 1);
-    }
-}
-
-OrientationSensor::~OrientationSensor() {
-    if (mEnabled) {
-        enable(0, 0);
-    }
-}
-
-int OrientationSensor::setDelay(int32_t handle __unused, int64_t ns)
-{
-    int fd;
-
-    if (ns < 10000000)
-        ns = 10;
-    else
-        ns /= 1000000;
-
-    strcpy(&input_sysfs_path[input_sysfs_path_len], "delay");
-    fd = open(input_sysfs_path, O_RDWR);
-    if (fd >= 0) {
-        char buf[80];
-        sprintf(buf, "%lld", ns);
-        write(fd, buf, strlen(buf)+1);
-        close(fd);
-        return 0;
-    }
-    return -1;
-}
-
-int OrientationSensor::enable(int32_t handle __unused, int en)
-{
-    int flags = en ? 1 : 0;
-    int fd;
-    if (flags != mEnabled) {
-        strcpy(&input_sysfs_path[input_sysfs_path_len], "enable");
-        fd = open(input_sysfs_path, O_RDWR);
-        if (fd >= 0) {
-            write(fd, en == 1 ? "1" : "0", 2);
-            close(fd);
-            mEnabled = flags;
-            return 0;
-        }
-        return -1;
-    }
-    return 0;
-}
-
-bool OrientationSensor::hasPendingEvents() const {
-    return mHasPendingEvent;
-}
-
-int OrientationSensor::readEvents(sensors_event_t* data, int count)
-{
-    if (count < 1)
-        return -EINVAL;
-
-    if (mHasPendingEvent) {
-        mHasPendingEvent = false;
-        mPendingEvent.timestamp = getTimestamp();
-        *data = mPendingEvent;
-        return mEnabled ? 1 : 0;
-    }
-
-    ssize_t n = mInputReader.fill(data_fd);
-    if (n < 0)
-        return n;
-
-    int numEventReceived = 0;
-    input_event const* event;
-
-    while (count && mInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_ABS) {
-            switch (event->code) {
-                case ABS_X:
-                    mPendingEvent.orientation.azimuth = event->value / 1000.0f;
-                    break;
-                case ABS_Y:
-                    mPendingEvent.orientation.pitch = event->value / 1000.0f;
-                    break;
-                case ABS_Z:
-                    mPendingEvent.orientation.roll = event->value / 1000.0f;
-                    break;
-            }
-        } else if (type == EV_SYN) {
-            mPendingEvent.timestamp = timevalToNano(event->time);
-            if (mEnabled) {
-                *data++ = mPendingEvent;
-                count--;
-                numEventReceived++;
-            }
-        } else {
-            ALOGE("unknown event (type=%d, code=%d, value=%d)",
-                    type, event->code, event->value);
-        }
-        mInputReader.next();
-    }
-
-    return numEventReceived;
-}
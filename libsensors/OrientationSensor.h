@@ -17,32 +17,27 @@
 #ifndef ANDROID_ORIENTATION_SENSOR_H
 #define ANDROID_ORIENTATION_SENSOR_H
 
-#include <stdint.h>
-#include <errno.h>
-#include <sys/cdefs.h>
-#include <sys/types.h>
-
 #include "sensors.h"
-#include "SensorBase.h"
-#include "InputEventReader.h"
-
-class OrientationSensor : public SensorBase {
-    int mEnabled;
-    InputEventCircularReader mInputReader;
-    sensors_event_t mPendingEvent;
-    bool mHasPendingEvent;
-    char input_sysfs_path[PATH_MAX];
-    int input_sysfs_path_len;
-
-public:
-            OrientationSensor();
-    virtual ~OrientationSensor();
-    virtual int readEvents(sensors_event_t* data, int count);
-    virtual bool hasPendingEvents() const;
-    virtual int setDelay(int32_t handle, int64_t ns);
-    virtual int enable(int32_t handle, int enabled);
+#include "InputSensor.h"
+
+struct OrientationTraits : ThreeAxisTraits {
+    static const char* inputName() { return "orientation"; }
+
+    enum {
+        handle = ID_O,
+        sensorType = SENSOR_TYPE_ORIENTATION,
+        // orientationd may add its filtered quaternion on ABS_RX/RY/RZ/
+        // RUDDER, which axis() leaves out: room for the longer frames
+        eventsPerFrame = 8,
+    };
+
+    constexpr float convert(int value) const {
+        return value / 1000.0f;
+    }
 };
 
+typedef InputSensor<OrientationTraits> OrientationSensor;
+
 /*****************************************************************************/
 
 #endif  // ANDROID_ORIENTATION_SENSOR_H
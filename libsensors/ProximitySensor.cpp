@@ -1,137 +0,0 @@
-/*
- * Copyright 2016 The Android Open Source Project
- *
- * Licensed under the Apache License, Version 2.0 (the "License");
- * you may not use this file except in compliance with the License.
- * You may obtain a copy of the License at
- *
- *      http://www.apache.org/licenses/LICENSE-2.0
- *
- * Unless required by applicable law or agreed to in writing, software
- * distributed under the License is distributed on an "AS IS" BASIS,
- * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
- * See the License for the specific language governing permissions and
- * limitations under the License.
- */
-
-#define LOG_TAG "ProximitySensor"
-
-#include <fcntl.h>
-#include <errno.h>
-#include <math.h>
-#include <poll.h>
-#include <unistd.h>
-#include <dirent.h>
-#include <sys/select.h>
-#include <cstring>
-
-#include <cutils/log.h>
-
-#include "ProximitySensor.h"
-
-ProximitySensor::ProximitySensor()
-    : SensorBase(NULL, "proximity_sensor"),
-    mEnabled(0),
-    mInputReader(4),
-    mHasPendingEvent(false)
-{
-    ALOGV("%s", __PRETTY_FUNCTION__);
-    mPendingEvent.version = sizeof(sensors_event_t);
-    mPendingEvent.sensor = ID_PX;
-    mPendingEvent.type = SENSOR_TYPE_PROXIMITY;
-    memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
-
-    if (data_fd) {
-        strcpy(input_sysfs_path, "/sys/class/input/");
-        strcat(input_sysfs_path, input_name);
-        strcat(input_sysfs_path, "/device/");
-        input_sysfs_path_len = strlen(input_sysfs_path);
-        enable(0, 1);
-    }
-}
-
-ProximitySensor::~ProximitySensor() {
-    if (mEnabled) {
-        enable(0, 0);
-    }
-}
-
-int ProximitySensor::setInitialState()
-{
-    ALOGV("%s", __PRETTY_FUNCTION__);
-    struct input_absinfo absinfo;
-    if (!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_PROXIMITY), &absinfo)) {
-        // make sure to report an event immediately
-        mHasPendingEvent = true;
-        mPendingEvent.distance = (float) absinfo.value * 5.0f;
-    }
-    return 0;
-}
-
-int ProximitySensor::enable(int32_t, int en)
-{
-    ALOGV("%s", __PRETTY_FUNCTION__);
-    int flags = en ? 1 : 0;
-    int fd;
-    if (flags != mEnabled) {
-        strcpy(&input_sysfs_path[input_sysfs_path_len], "enable");
-        fd = open(input_sysfs_path, O_RDWR);
-        if (fd >= 0) {
-            write(fd, en == 1 ? "1" : "0", 2);
-            close(fd);
-            mEnabled = flags;
-            setInitialState();
-            return 0;
-        }
-        return -1;
-    }
-    return 0;
-}
-
-bool ProximitySensor::hasPendingEvents() const
-{
-    return mHasPendingEvent;
-}
-
-int ProximitySensor::readEvents(sensors_event_t* data, int count)
-{
-    ALOGV("%s", __PRETTY_FUNCTION__);
-    if (count < 1)
-        return -EINVAL;
-
-    if (mHasPendingEvent) {
-        mHasPendingEvent = false;
-        mPendingEvent.timestamp = getTimestamp();
-        *data = mPendingEvent;
-        return mEnabled ? 1 : 0;
-    }
-
-    ssize_t n = mInputReader.fill(data_fd);
-    if (n < 0)
-        return n;
-
-    int numEventReceived = 0;
-    input_event const* event;
-
-    while (count && mInputReader.readEvent(&event)) {
-        int type = event->type;
-        if (type == EV_ABS) {
-            if (event->code == EVENT_TYPE_PROXIMITY) {
-                mPendingEvent.distance = (float) event->value * 5.0f;
-            }
-        } else if (type == EV_SYN) {
-            mPendingEvent.timestamp = timevalToNano(event->time);
-            if (mEnabled) {
-                *data++ = mPendingEvent;
-                count--;
-                numEventReceived++;
-            }
-        } else {
-            ALOGE("unknown event (type=%d, code=%d, value=%d)",
-                    type, event->code, event->value);
-        }
-        mInputReader.next();
-    }
-
-    return numEventReceived;
-}
@@ -17,33 +17,44 @@
 #ifndef ANDROID_PROXIMITY_SENSOR_H
 #define ANDROID_PROXIMITY_SENSOR_H
 
-#include <stdint.h>
-#include <errno.h>
-#include <sys/cdefs.h>
-#include <sys/types.h>
-
 #include "sensors.h"
-#include "SensorBase.h"
-#include "InputEventReader.h"
-
-class ProximitySensor : public SensorBase {
-    int mEnabled;
-    InputEventCircularReader mInputReader;
-    sensors_event_t mPendingEvent;
-    bool mHasPendingEvent;
-    char input_sysfs_path[PATH_MAX];
-    int input_sysfs_path_len;
-
-    int setInitialState();
-
-public:
-            ProximitySensor();
-    virtual ~ProximitySensor();
-    virtual int readEvents(sensors_event_t* data, int count);
-    virtual bool hasPendingEvents() const;
-    virtual int enable(int32_t handle, int enabled);
+#include "InputSensor.h"
+
+struct ProximityTraits {
+    static const char* inputName() { return "proximity_sensor"; }
+    static const char* delayAttribute() { return NULL; }
+
+    enum {
+        handle = ID_PX,
+        sensorType = SENSOR_TYPE_PROXIMITY,
+        eventType = EV_ABS,
+        eventsPerFrame = 2,
+        initialStateCode = EVENT_TYPE_PROXIMITY,
+        smoothTimestamps = 0,
+    };
+
+    static const int64_t minDelay = 10000000;
+
+    static constexpr int axis(int code) {
+        return code == EVENT_TYPE_PROXIMITY ? 0 : -1;
+    }
+
+    static constexpr int64_t delayValue(int64_t ns) {
+        return ns;
+    }
+
+    constexpr float convert(int value) const {
+        return value * 5.0f;
+    }
+
+    // the driver only reports transitions
+    static constexpr bool changed(const sensors_event_t&, const sensors_event_t&) {
+        return true;
+    }
 };
 
+typedef InputSensor<ProximityTraits> ProximitySensor;
+
 /*****************************************************************************/
 
 #endif  // ANDROID_PROXIMITY_SENSOR_H
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SensorBackend"
+
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <cstring>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include <linux/input.h>
+
+#include "SensorBackend.h"
+#include "SimulatedBackend.h"
+#include "input_index.h"
+
+/*****************************************************************************/
+
+/*
+ * Have evdev stamp events with CLOCK_BOOTTIME, like the rest of the HAL.
+ * Older kernels only take CLOCK_MONOTONIC, or keep CLOCK_REALTIME; their
+ * timestamps are moved to CLOCK_BOOTTIME by SensorBase::inputClockOffset().
+ */
+static clockid_t setInputClock(int fd, const char* name)
+{
+#ifdef EVIOCSCLOCKID
+    static const clockid_t clocks[] = { CLOCK_BOOTTIME, CLOCK_MONOTONIC };
+    for (size_t i = 0; i < ARRAY_SIZE(clocks); i++) {
+        int clock = clocks[i];
+        if (!ioctl(fd, EVIOCSCLOCKID, &clock))
+            return clocks[i];
+    }
+#endif
+    ALOGW("%s: events stamped with CLOCK_REALTIME", name);
+    return CLOCK_REALTIME;
+}
+
+int EvdevBackend::openInput(const char* name, clockid_t* clock)
+{
+    char node[PATH_MAX];
+
+    int fd = input_index_open(name, O_RDONLY | O_NONBLOCK, node, sizeof(node));
+    if (fd < 0)
+        return fd;
+
+    *clock = setInputClock(fd, name);
+    return fd;
+}
+
+int EvdevBackend::attributePath(const char* name, char* path, size_t size)
+{
+    int err = input_index_sysfs_path(name, path, size);
+    if (err)
+        return err;
+
+    size_t len = strlen(path);
+    if (len + 1 >= size)
+        return -ENAMETOOLONG;
+
+    path[len] = '/';
+    path[len + 1] = '\0';
+    return 0;
+}
+
+/*****************************************************************************/
+
+static SensorBackend* createBackend()
+{
+    char value[PROPERTY_VALUE_MAX];
+    const char* backend = getenv("SENSORS_BACKEND");
+
+    if (backend == NULL) {
+        property_get("persist.sensors.backend", value, "evdev");
+        backend = value;
+    }
+
+    if (!strcmp(backend, "sim")) {
+        char spec[PROPERTY_VALUE_MAX];
+        const char* simSpec = getenv("SENSORS_SIM");
+
+        if (simSpec == NULL) {
+            property_get("persist.sensors.sim", spec, "");
+            simSpec = spec;
+        }
+
+        ALOGI("using the simulated sensors \"%s\"", simSpec);
+        return new SimulatedBackend(simSpec);
+    }
+
+    ALOGE_IF(strcmp(backend, "evdev"), "unknown backend %s, using evdev", backend);
+    return new EvdevBackend();
+}
+
+SensorBackend* SensorBackend::get()
+{
+    static SensorBackend* const sBackend = createBackend();
+    return sBackend;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_BACKEND_H
+#define ANDROID_SENSOR_BACKEND_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+
+/*****************************************************************************/
+
+/*
+ * Where SensorBase gets the event stream and the enable/delay attributes
+ * of an input device from. The evdev backend binds to the kernel drivers.
+ * Setting the SENSORS_BACKEND environment variable or the
+ * persist.sensors.backend property to "sim" selects SimulatedBackend
+ * instead, which runs the HAL without the hardware.
+ */
+class SensorBackend {
+public:
+    virtual ~SensorBackend() {}
+
+    // non-blocking fd reading the struct input_event frames of the named
+    // device, stamped with *clock, or a negative errno
+    virtual int openInput(const char* name, clockid_t* clock) = 0;
+
+    // directory holding the attributes of the device, with a trailing /
+    virtual int attributePath(const char* name, char* path, size_t size) = 0;
+
+    // backend of this process, selected on first use
+    static SensorBackend* get();
+};
+
+class EvdevBackend : public SensorBackend {
+public:
+    virtual int openInput(const char* name, clockid_t* clock);
+    virtual int attributePath(const char* name, char* path, size_t size);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_BACKEND_H
@@ -20,8 +20,8 @@
 #include <errno.h>
 #include <math.h>
 #include <poll.h>
+#include <stdio.h>
 #include <unistd.h>
-#include <dirent.h>
 #include <sys/select.h>
 #include <cstring>
 
@@ -30,16 +30,65 @@
 #include <linux/input.h>
 
 #include "SensorBase.h"
+#include "SensorBackend.h"
+
+SysfsAttribute::SysfsAttribute()
+    : mFd(-1), mValue(0), mValid(false)
+{
+}
+
+SysfsAttribute::~SysfsAttribute() {
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+int SysfsAttribute::open(const char* path) {
+    mFd = ::open(path, O_RDWR | O_CLOEXEC);
+    mValid = false;
+    ALOGE_IF(mFd < 0, "Couldn't open %s (%s)", path, strerror(errno));
+    return mFd < 0 ? -errno : 0;
+}
+
+int SysfsAttribute::write(int64_t value) {
+    if (mFd < 0)
+        return -ENODEV;
+
+    if (mValid && mValue == value)
+        return 0;
+
+    char buf[32];
+    int len = sprintf(buf, "%lld", (long long) value) + 1;
+    if (pwrite(mFd, buf, len, 0) < 0) {
+        mValid = false;
+        return -errno;
+    }
+
+    mValue = value;
+    mValid = true;
+    return 0;
+}
+
+/*****************************************************************************/
 
 SensorBase::SensorBase(
         const char* dev_name,
         const char* data_name)
     : dev_name(dev_name), data_name(data_name),
-      dev_fd(-1), data_fd(-1)
+      input_sysfs_path_len(0),
+      dev_fd(-1), data_fd(-1), input_clock(CLOCK_REALTIME)
 {
+    input_sysfs_path[0] = '\0';
+
     if (data_name) {
         data_fd = openInput(data_name);
     }
+
+    if (data_fd >= 0 &&
+            !SensorBackend::get()->attributePath(data_name,
+                    input_sysfs_path, sizeof(input_sysfs_path))) {
+        input_sysfs_path_len = strlen(input_sysfs_path);
+    }
 }
 
 SensorBase::~SensorBase() {
@@ -67,6 +116,14 @@ int SensorBase::close_device() {
     return 0;
 }
 
+int SensorBase::openSysfsAttribute(SysfsAttribute& attr, const char* name) {
+    if (!input_sysfs_path_len)
+        return -ENODEV;
+
+    strcpy(&input_sysfs_path[input_sysfs_path_len], name);
+    return attr.open(input_sysfs_path);
+}
+
 int SensorBase::getFd() const {
     if (!data_name) {
         return dev_fd;
@@ -82,49 +139,24 @@ bool SensorBase::hasPendingEvents() const {
     return false;
 }
 
-int64_t SensorBase::getTimestamp() {
+static int64_t clockNs(clockid_t clock) {
     struct timespec t;
     t.tv_sec = t.tv_nsec = 0;
-    clock_gettime(CLOCK_BOOTTIME, &t);
+    clock_gettime(clock, &t);
     return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
 }
 
-int SensorBase::openInput(const char* inputName) {
-    int fd = -1;
-    const char *dirname = "/dev/input";
-    char devname[PATH_MAX];
-    char *filename;
-    DIR *dir;
-    struct dirent *de;
-    dir = opendir(dirname);
-    if(dir == NULL)
-        return -1;
-    strcpy(devname, dirname);
-    filename = devname + strlen(devname);
-    *filename++ = '/';
-    while((de = readdir(dir))) {
-        if(de->d_name[0] == '.' &&
-                (de->d_name[1] == '\0' ||
-                        (de->d_name[1] == '.' && de->d_name[2] == '\0')))
-            continue;
-        strcpy(filename, de->d_name);
-        fd = open(devname, O_RDONLY);
-        if (fd >= 0) {
-            char name[80];
-            if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) < 1) {
-                name[0] = '\0';
-            }
-            if (!strcmp(name, inputName)) {
-                strcpy(input_name, filename);
-                break;
-            } else {
-                close(fd);
-                fd = -1;
-            }
-        }
-    }
-    closedir(dir);
-    ALOGE_IF(fd < 0, "couldn't find '%s' input device", inputName);
+int64_t SensorBase::inputClockOffset() const {
+    if (input_clock == CLOCK_BOOTTIME)
+        return 0;
+    return clockNs(CLOCK_BOOTTIME) - clockNs(input_clock);
+}
 
-    return fd;
+int64_t SensorBase::getTimestamp() {
+    return clockNs(CLOCK_BOOTTIME);
+}
+
+int SensorBase::openInput(const char* inputName) {
+    int fd = SensorBackend::get()->openInput(inputName, &input_clock);
+    return fd < 0 ? -1 : fd;
 }
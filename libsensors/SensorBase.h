@@ -29,16 +29,36 @@
 
 struct sensors_event_t;
 
+/*
+ * Sysfs attribute of an input device that is kept open and rewritten in
+ * place. Writing the value it already holds is skipped.
+ */
+class SysfsAttribute {
+    int mFd;
+    int64_t mValue;
+    bool mValid;
+
+public:
+            SysfsAttribute();
+            ~SysfsAttribute();
+    int open(const char* path);
+    int write(int64_t value);
+};
+
 class SensorBase {
 protected:
     const char* dev_name;
     const char* data_name;
-    char        input_name[PATH_MAX];
+    char        input_sysfs_path[PATH_MAX];
+    int         input_sysfs_path_len;
     int         dev_fd;
     int         data_fd;
+    clockid_t   input_clock;
 
     int openInput(const char* inputName);
+    int openSysfsAttribute(SysfsAttribute& attr, const char* name);
     static int64_t getTimestamp();
+    int64_t inputClockOffset() const;
 
 
     static int64_t timevalToNano(timeval const& t) {
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <errno.h>
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <cstring>
+
+#include "SensorEventFifo.h"
+
+/*****************************************************************************/
+
+SensorEventFifo::SensorEventFifo(size_t numEvents)
+    : mBuffer(new sensors_event_t[numEvents]),
+      mSize(numEvents),
+      mHead(0),
+      mCount(0)
+{
+}
+
+SensorEventFifo::~SensorEventFifo()
+{
+    delete [] mBuffer;
+}
+
+bool SensorEventFifo::push(sensors_event_t const& event)
+{
+    bool overrun = full();
+
+    mBuffer[mHead] = event;
+    mHead = (mHead + 1) % mSize;
+    if (!overrun)
+        mCount++;
+
+    return !overrun;
+}
+
+size_t SensorEventFifo::pop(sensors_event_t* data, size_t count)
+{
+    size_t tail = (mHead + mSize - mCount) % mSize;
+    size_t n = count < mCount ? count : mCount;
+
+    // copy out in at most two chunks, around the end of the buffer
+    size_t first = mSize - tail;
+    if (first > n)
+        first = n;
+    memcpy(data, mBuffer + tail, first * sizeof(sensors_event_t));
+    memcpy(data + first, mBuffer, (n - first) * sizeof(sensors_event_t));
+
+    mCount -= n;
+    return n;
+}
+
+// oldest event, the FIFO must not be empty
+const sensors_event_t& SensorEventFifo::front() const
+{
+    return mBuffer[(mHead + mSize - mCount) % mSize];
+}
+
+void SensorEventFifo::clear()
+{
+    mCount = 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_EVENT_FIFO_H
+#define ANDROID_SENSOR_EVENT_FIFO_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+
+/*****************************************************************************/
+
+/*
+ * Fixed size software FIFO holding decoded events of a batched sensor until
+ * its report latency expires. When full, the oldest event is overwritten.
+ */
+class SensorEventFifo
+{
+    sensors_event_t* const mBuffer;
+    const size_t mSize;
+    size_t mHead;
+    size_t mCount;
+
+public:
+    SensorEventFifo(size_t numEvents);
+    ~SensorEventFifo();
+    bool push(sensors_event_t const& event);
+    size_t pop(sensors_event_t* data, size_t count);
+    const sensors_event_t& front() const;
+    void clear();
+
+    size_t size() const { return mCount; }
+    size_t capacity() const { return mSize; }
+    bool empty() const { return mCount == 0; }
+    bool full() const { return mCount == mSize; }
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_EVENT_FIFO_H
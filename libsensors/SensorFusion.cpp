@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SensorFusion"
+
+#include <math.h>
+#include <cstring>
+
+#include <cutils/log.h>
+
+#include "SensorFusion.h"
+
+/*****************************************************************************/
+
+// Low-pass time constants, in seconds
+#define GRAVITY_TIME_CONSTANT   0.2f
+#define MAGNETIC_TIME_CONSTANT  0.3f
+
+// Longest gap between samples still considered continuous, in ns
+#define MAX_SAMPLE_GAP          200000000LL
+
+static float lowPassFactor(int64_t last, int64_t now, float timeConstant)
+{
+    if (!last || now <= last || now - last > MAX_SAMPLE_GAP)
+        return 1.0f;
+
+    float dt = (now - last) * 1e-9f;
+    return dt / (timeConstant + dt);
+}
+
+static void cross(const float a[3], const float b[3], float r[3])
+{
+    r[0] = a[1] * b[2] - a[2] * b[1];
+    r[1] = a[2] * b[0] - a[0] * b[2];
+    r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static bool normalize(float v[3])
+{
+    float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length < 1e-6f)
+        return false;
+
+    v[0] /= length;
+    v[1] /= length;
+    v[2] /= length;
+    return true;
+}
+
+/*
+ * Projects v onto the plane normal to the unit vector up and normalizes
+ * it, false if v is (nearly) along up
+ */
+static bool horizontal(const float up[3], float v[3])
+{
+    float d = v[0] * up[0] + v[1] * up[1] + v[2] * up[2];
+
+    for (int i = 0; i < 3; i++)
+        v[i] -= d * up[i];
+
+    return normalize(v);
+}
+
+SensorFusion::SensorFusion()
+{
+    reset();
+}
+
+void SensorFusion::reset()
+{
+    memset(mGravity, 0, sizeof(mGravity));
+    memset(mAcceleration, 0, sizeof(mAcceleration));
+    memset(mMagnetic, 0, sizeof(mMagnetic));
+    memset(mMagneticSample, 0, sizeof(mMagneticSample));
+    memset(mRotation, 0, sizeof(mRotation));
+    memset(mGameRotation, 0, sizeof(mGameRotation));
+    memset(mGameNorth, 0, sizeof(mGameNorth));
+    mAccelerationTimestamp = 0;
+    mMagneticTimestamp = 0;
+    mHasGravity = false;
+    mHasMagnetic = false;
+    mHasRotation = false;
+}
+
+/*
+ * Attitude of the device as a quaternion (x, y, z, w), from the world up
+ * vector and a horizontal reference, both in device coordinates. This is
+ * the quaternion form of SensorManager.getRotationMatrix(), with east,
+ * north and up as the rows of the rotation matrix.
+ */
+bool SensorFusion::attitude(const float up[3], const float ref[3], float q[4])
+{
+    float a[3] = { up[0], up[1], up[2] };
+    float h[3], m[3];
+
+    if (!normalize(a))
+        return false;
+
+    cross(ref, a, h);
+    if (!normalize(h))
+        return false;
+
+    cross(a, h, m);
+
+    // Shepperd's method, picking the largest diagonal term for stability
+    float trace = h[0] + m[1] + a[2];
+    if (trace > 0) {
+        float s = sqrtf(trace + 1.0f) * 2.0f;
+        q[3] = 0.25f * s;
+        q[0] = (a[1] - m[2]) / s;
+        q[1] = (h[2] - a[0]) / s;
+        q[2] = (m[0] - h[1]) / s;
+    } else if (h[0] > m[1] && h[0] > a[2]) {
+        float s = sqrtf(1.0f + h[0] - m[1] - a[2]) * 2.0f;
+        q[3] = (a[1] - m[2]) / s;
+        q[0] = 0.25f * s;
+        q[1] = (h[1] + m[0]) / s;
+        q[2] = (h[2] + a[0]) / s;
+    } else if (m[1] > a[2]) {
+        float s = sqrtf(1.0f + m[1] - h[0] - a[2]) * 2.0f;
+        q[3] = (h[2] - a[0]) / s;
+        q[0] = (h[1] + m[0]) / s;
+        q[1] = 0.25f * s;
+        q[2] = (m[2] + a[1]) / s;
+    } else {
+        float s = sqrtf(1.0f + a[2] - h[0] - m[1]) * 2.0f;
+        q[3] = (m[0] - h[1]) / s;
+        q[0] = (h[2] + a[0]) / s;
+        q[1] = (m[2] + a[1]) / s;
+        q[2] = 0.25f * s;
+    }
+
+    // keep a continuous sign, the rotation vector wants w >= 0
+    if (q[3] < 0) {
+        q[0] = -q[0];
+        q[1] = -q[1];
+        q[2] = -q[2];
+        q[3] = -q[3];
+    }
+
+    return true;
+}
+
+void SensorFusion::handleAcceleration(const sensors_vec_t& acceleration,
+        int64_t timestamp)
+{
+    float k = mHasGravity ?
+            lowPassFactor(mAccelerationTimestamp, timestamp, GRAVITY_TIME_CONSTANT) : 1.0f;
+
+    for (int i = 0; i < 3; i++) {
+        mAcceleration[i] = acceleration.v[i];
+        mGravity[i] += k * (acceleration.v[i] - mGravity[i]);
+    }
+    mAccelerationTimestamp = timestamp;
+    mHasGravity = true;
+
+    // without a heading reference the game rotation vector only tilts:
+    // the previous pseudo north is projected back onto the horizontal
+    // plane, so that it turns with the tilt and never jumps. It starts as
+    // the device y axis, or the x axis when the y axis points up.
+    float g[3] = { mGravity[0], mGravity[1], mGravity[2] };
+    if (normalize(g)) {
+        if (!horizontal(g, mGameNorth)) {
+            float axis[3] = { 0.0f, 0.0f, 0.0f };
+            axis[fabsf(g[1]) < 0.9f ? 1 : 0] = 1.0f;
+            horizontal(g, axis);
+            memcpy(mGameNorth, axis, sizeof(axis));
+        }
+        attitude(mGravity, mGameNorth, mGameRotation);
+    }
+
+    if (mHasMagnetic)
+        mHasRotation = attitude(mGravity, mMagnetic, mRotation);
+}
+
+void SensorFusion::handleMagnetic(const sensors_vec_t& magnetic,
+        int64_t timestamp)
+{
+    float k = mHasMagnetic ?
+            lowPassFactor(mMagneticTimestamp, timestamp, MAGNETIC_TIME_CONSTANT) : 1.0f;
+
+    for (int i = 0; i < 3; i++) {
+        mMagneticSample[i] = magnetic.v[i];
+        mMagnetic[i] += k * (magnetic.v[i] - mMagnetic[i]);
+    }
+    mMagneticTimestamp = timestamp;
+    mHasMagnetic = true;
+}
+
+bool SensorFusion::getGravity(float* data) const
+{
+    if (!mHasGravity)
+        return false;
+
+    memcpy(data, mGravity, sizeof(mGravity));
+    return true;
+}
+
+bool SensorFusion::getLinearAcceleration(float* data) const
+{
+    if (!mHasGravity)
+        return false;
+
+    for (int i = 0; i < 3; i++)
+        data[i] = mAcceleration[i] - mGravity[i];
+    return true;
+}
+
+bool SensorFusion::getRotationVector(float* data) const
+{
+    if (!mHasRotation)
+        return false;
+
+    memcpy(data, mRotation, sizeof(mRotation));
+    // no estimate of the heading accuracy
+    data[4] = -1.0f;
+    return true;
+}
+
+bool SensorFusion::getGameRotationVector(float* data) const
+{
+    if (!mHasGravity)
+        return false;
+
+    memcpy(data, mGameRotation, sizeof(mGameRotation));
+    return true;
+}
+
+/*
+ * Legacy azimuth/pitch/roll, in degrees, from the latest unfiltered
+ * samples. Pitch and roll are the tilt of the up vector, like orientationd,
+ * the azimuth is the heading of the y axis, like
+ * SensorManager.getOrientation(), which stays right when the device is
+ * both pitched and rolled.
+ */
+bool SensorFusion::getOrientation(float* data) const
+{
+    const float* a = mAcceleration;
+    const float* m = mMagneticSample;
+
+    if (!mHasGravity || !mHasMagnetic)
+        return false;
+
+    float la = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    if (la < 1e-6f)
+        return false;
+
+    float pitch = asinf(-a[1] / la);
+    float roll = asinf(a[0] / la);
+
+    // east and north in device coordinates, n is la times longer than h
+    float h[3], n[3];
+    cross(m, a, h);
+    cross(a, h, n);
+    if (h[0] * h[0] + h[1] * h[1] + h[2] * h[2] < 1e-12f)
+        return false;
+
+    float azimuth = atan2f(h[1] * la, n[1]) * float(180.0 / M_PI);
+
+    data[0] = azimuth < 0 ? azimuth + 360.0f : azimuth;
+    data[1] = pitch * float(180.0 / M_PI);
+    data[2] = roll * float(180.0 / M_PI);
+    return true;
+}
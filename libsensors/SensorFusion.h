@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_FUSION_H
+#define ANDROID_SENSOR_FUSION_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+
+/*****************************************************************************/
+
+/*
+ * Gyro-less accelerometer/magnetometer fusion backing the virtual sensors.
+ * Gravity and the magnetic field are low-pass filtered, the attitude
+ * quaternions are derived from the filtered vectors. All state is kept
+ * in place, nothing is allocated per sample.
+ */
+class SensorFusion
+{
+    float mGravity[3];
+    float mAcceleration[3];
+    float mMagnetic[3];
+    float mMagneticSample[3];
+    float mRotation[4];
+    float mGameRotation[4];
+    float mGameNorth[3];
+    int64_t mAccelerationTimestamp;
+    int64_t mMagneticTimestamp;
+    bool mHasGravity;
+    bool mHasMagnetic;
+    bool mHasRotation;
+
+    static bool attitude(const float up[3], const float ref[3], float q[4]);
+
+public:
+    SensorFusion();
+    void reset();
+    void handleAcceleration(const sensors_vec_t& acceleration, int64_t timestamp);
+    void handleMagnetic(const sensors_vec_t& magnetic, int64_t timestamp);
+
+    bool hasGravity() const { return mHasGravity; }
+    bool hasRotation() const { return mHasRotation; }
+
+    // fill the data of a virtual sensor event, false if not available yet
+    bool getGravity(float* data) const;
+    bool getLinearAcceleration(float* data) const;
+    bool getRotationVector(float* data) const;
+    bool getGameRotationVector(float* data) const;
+    bool getOrientation(float* data) const;
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_FUSION_H
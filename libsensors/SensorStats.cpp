@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SensorStats"
+
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <cstring>
+
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+
+#include "SensorStats.h"
+
+/*****************************************************************************/
+
+struct HandleStats {
+    volatile int32_t counters[SensorStats::numCounters];
+    volatile int32_t interval[SensorStats::numBuckets];
+    volatile int32_t latency[SensorStats::numBuckets];
+    volatile int32_t startup[SensorStats::numBuckets];
+    int64_t lastTimestamp; // only touched by the poll thread
+};
+
+static HandleStats sStats[ID_MAX];
+
+static const char* const sCounterNames[SensorStats::numCounters] = {
+    "decoded",
+    "delivered",
+    "disabled",
+    "decimated",
+    "unchanged",
+    "overruns",
+    "unknown",
+    "fill_errors",
+    "activate",
+    "set_delay",
+    "driver_err",
+};
+
+static int bucket(int64_t ns)
+{
+    uint64_t us = ns > 0 ? ns / 1000 : 0;
+    if (us < 2)
+        return 0;
+
+    int i = 63 - __builtin_clzll(us);
+    return i < SensorStats::numBuckets ? i : SensorStats::numBuckets - 1;
+}
+
+void SensorStats::count(int handle, Counter counter)
+{
+    if (handle > 0 && handle < ID_MAX)
+        android_atomic_inc(&sStats[handle].counters[counter]);
+}
+
+void SensorStats::count(int handle, Counter counter, int n)
+{
+    if (handle > 0 && handle < ID_MAX && n)
+        android_atomic_add(n, &sStats[handle].counters[counter]);
+}
+
+void SensorStats::delivered(const sensors_event_t& event, int64_t now)
+{
+    if (event.type == SENSOR_TYPE_META_DATA ||
+            event.sensor <= 0 || event.sensor >= ID_MAX)
+        return;
+
+    HandleStats* const stats(&sStats[event.sensor]);
+
+    android_atomic_inc(&stats->counters[EVENTS_DELIVERED]);
+    android_atomic_inc(&stats->latency[bucket(now - event.timestamp)]);
+    if (stats->lastTimestamp)
+        android_atomic_inc(&stats->interval[bucket(event.timestamp - stats->lastTimestamp)]);
+    stats->lastTimestamp = event.timestamp;
+}
+
+void SensorStats::startup(int handle, int64_t ns)
+{
+    if (handle > 0 && handle < ID_MAX)
+        android_atomic_inc(&sStats[handle].startup[bucket(ns)]);
+}
+
+static void dumpHistogram(int fd, const char* name, volatile int32_t* buckets)
+{
+    dprintf(fd, "  %-12s", name);
+    for (int i = 0; i < SensorStats::numBuckets; i++)
+        dprintf(fd, " %d", buckets[i]);
+    dprintf(fd, "\n");
+}
+
+void SensorStats::dump(int fd)
+{
+    dprintf(fd, "# histogram bucket i counts [2^i, 2^(i+1)) us, bucket 0 below 2 us\n");
+
+    for (int h = 1; h < ID_MAX; h++) {
+        HandleStats* const stats(&sStats[h]);
+        bool used = false;
+
+        for (int i = 0; i < numCounters; i++)
+            used |= stats->counters[i] != 0;
+        if (!used)
+            continue;
+
+        dprintf(fd, "handle %d\n", h);
+        for (int i = 0; i < numCounters; i++)
+            dprintf(fd, "  %-12s %d\n", sCounterNames[i], stats->counters[i]);
+        dumpHistogram(fd, "interval", stats->interval);
+        dumpHistogram(fd, "latency", stats->latency);
+        dumpHistogram(fd, "startup", stats->startup);
+    }
+}
+
+int SensorStats::writeFile(const char* path)
+{
+    char tmp[PATH_MAX];
+
+    // readers never see a partial file
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (fd < 0)
+        return -errno;
+
+    dump(fd);
+    close(fd);
+
+    if (rename(tmp, path) < 0) {
+        int err = -errno;
+        unlink(tmp);
+        return err;
+    }
+
+    return 0;
+}
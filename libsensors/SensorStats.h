@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_STATS_H
+#define ANDROID_SENSOR_STATS_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+
+/*****************************************************************************/
+
+/* Where the HAL writes dump() on request, see STATS_DUMP_PROPERTY */
+#ifndef SENSORS_STATS_FILE
+#define SENSORS_STATS_FILE "/data/sensors/stats"
+#endif
+
+/*
+ * Per-handle runtime counters and histograms. Every update is a single
+ * atomic add, so the decoders, the poll loop and the framework threads
+ * record without taking a lock. Histograms have log2 buckets in
+ * microseconds.
+ */
+class SensorStats
+{
+public:
+    enum Counter {
+        EVENTS_DECODED = 0,
+        EVENTS_DELIVERED,
+        EVENTS_DISABLED,    // decoded while the driver was disabled
+        EVENTS_DECIMATED,
+        EVENTS_UNCHANGED,   // on-change sample within the hysteresis
+        FIFO_OVERRUNS,
+        UNKNOWN_EVENTS,
+        FILL_ERRORS,
+        ACTIVATE_CALLS,
+        SET_DELAY_CALLS,
+        DRIVER_ERRORS,      // failed enable/delay writes
+        numCounters,
+    };
+
+    enum {
+        numBuckets = 20,
+    };
+
+    static void count(int handle, Counter counter);
+    static void count(int handle, Counter counter, int n);
+
+    // a delivered event, records latency and inter-arrival time
+    static void delivered(const sensors_event_t& event, int64_t now);
+    // time from activate() to the delivery of the first sample
+    static void startup(int handle, int64_t ns);
+
+    static void dump(int fd);
+    static int writeFile(const char* path);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_STATS_H
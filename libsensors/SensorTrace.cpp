@@ -0,0 +1,733 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SensorTrace"
+
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <cstring>
+
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include <linux/input.h>
+
+#include "SensorTrace.h"
+
+/*****************************************************************************/
+
+#define BLOCK_MAGIC         0x4b4c4253  // "SBLK"
+#define INDEX_MAGIC         0x58444953  // "SIDX"
+#define TRAILER_MAGIC       "SNSINDEX"
+
+// frames are appended until the block reaches this size or time span
+#define BLOCK_SIZE          (64 * 1024)
+#define BLOCK_SPAN_US       10000000LL
+// largest encoded frame: header, timestamp, layout and values
+#define MAX_FRAME_BYTES     (1 + 10 + 5 + SENSOR_TRACE_MAX_FRAME * 16)
+
+#define FRAME_DEVICE_MASK   0x0f
+#define FRAME_LAYOUT        0x10
+#define FRAME_UNTERMINATED  0x20
+
+#define DEVICE_NAME_MAX     32
+
+struct file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct block_header {
+    uint32_t magic;
+    uint32_t size;          // bytes after the header
+    uint32_t frames;
+    uint32_t devices;
+    int64_t firstTime;      // us
+    int64_t lastTime;
+};
+
+struct trace_index_entry {
+    int64_t offset;
+    int64_t firstTime;
+    int64_t lastTime;
+};
+
+struct trailer {
+    int64_t indexOffset;
+    char magic[8];
+};
+
+// a finished block as written: header, device names and frames
+#define QUEUE_SLOT_SIZE     (sizeof(block_header) + \
+        SENSOR_TRACE_MAX_DEVICES * DEVICE_NAME_MAX + BLOCK_SIZE)
+
+static inline uint64_t zigzag(int64_t v)
+{
+    return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+    return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+static inline uint8_t* putVarint(uint8_t* p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = uint8_t(v) | 0x80;
+        v >>= 7;
+    }
+    *p++ = uint8_t(v);
+    return p;
+}
+
+static inline const uint8_t* getVarint(const uint8_t* p, const uint8_t* end, uint64_t* v)
+{
+    uint64_t result = 0;
+
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        result |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *v = result;
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+static inline int64_t eventTime(const input_event& event)
+{
+    return int64_t(event.time.tv_sec) * 1000000LL + event.time.tv_usec;
+}
+
+/*****************************************************************************/
+
+struct SensorTraceWriter::Device {
+    char name[DEVICE_NAME_MAX];
+    input_event pending[SENSOR_TRACE_MAX_FRAME];
+    size_t numPending;
+
+    // delta state, restarted with every block
+    size_t layoutSize;
+    uint16_t types[SENSOR_TRACE_MAX_FRAME];
+    uint16_t codes[SENSOR_TRACE_MAX_FRAME];
+    int32_t values[SENSOR_TRACE_MAX_FRAME];
+    int64_t time;
+};
+
+SensorTraceWriter::SensorTraceWriter()
+    : mFd(-1),
+    mOffset(0),
+    mDevices(new Device[SENSOR_TRACE_MAX_DEVICES]),
+    mNumDevices(0),
+    mBlock(new uint8_t[BLOCK_SIZE]),
+    mBlockSize(0),
+    mBlockFrames(0),
+    mBlockStart(0),
+    mBlockEnd(0),
+    mIndex(NULL),
+    mIndexSize(0),
+    mIndexCapacity(0),
+    mThreadStarted(false),
+    mQueue(new uint8_t[SENSOR_TRACE_QUEUE * QUEUE_SLOT_SIZE]),
+    mQueueHead(0),
+    mQueueCount(0),
+    mStop(false),
+    mFailed(0),
+    mDropped(0)
+{
+    pthread_mutex_init(&mLock, NULL);
+    pthread_mutex_init(&mQueueLock, NULL);
+    pthread_cond_init(&mQueueCond, NULL);
+    memset(mDevices, 0, SENSOR_TRACE_MAX_DEVICES * sizeof(Device));
+}
+
+SensorTraceWriter::~SensorTraceWriter()
+{
+    close();
+    delete [] mDevices;
+    delete [] mBlock;
+    delete [] mQueue;
+    free(mIndex);
+    pthread_cond_destroy(&mQueueCond);
+    pthread_mutex_destroy(&mQueueLock);
+    pthread_mutex_destroy(&mLock);
+}
+
+void* SensorTraceWriter::writerThread(void* arg)
+{
+    static_cast<SensorTraceWriter*>(arg)->writeQueue();
+    return NULL;
+}
+
+/*
+ * Writes the queued blocks in order until close(), the slot being
+ * written stays out of the producer's reach until it is done
+ */
+void SensorTraceWriter::writeQueue()
+{
+    pthread_mutex_lock(&mQueueLock);
+
+    while (true) {
+        while (!mQueueCount && !mStop)
+            pthread_cond_wait(&mQueueCond, &mQueueLock);
+        if (!mQueueCount)
+            break;
+
+        const uint8_t* block = mQueue + mQueueHead * QUEUE_SLOT_SIZE;
+        ssize_t size = mQueueSizes[mQueueHead];
+
+        pthread_mutex_unlock(&mQueueLock);
+        bool failed = android_atomic_acquire_load(&mFailed) ||
+                ::write(mFd, block, size) != size;
+        pthread_mutex_lock(&mQueueLock);
+
+        if (failed && !android_atomic_acquire_load(&mFailed)) {
+            ALOGE("trace write failed (%s), tracing stopped", strerror(errno));
+            android_atomic_release_store(1, &mFailed);
+        }
+
+        mQueueHead = (mQueueHead + 1) % SENSOR_TRACE_QUEUE;
+        mQueueCount--;
+    }
+
+    pthread_mutex_unlock(&mQueueLock);
+}
+
+int SensorTraceWriter::open(const char* path)
+{
+    file_header header;
+
+    mFd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (mFd < 0) {
+        ALOGE("Couldn't create %s (%s)", path, strerror(errno));
+        return -errno;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SENSOR_TRACE_MAGIC, sizeof(header.magic));
+    header.version = SENSOR_TRACE_VERSION;
+    if (::write(mFd, &header, sizeof(header)) != sizeof(header)) {
+        ::close(mFd);
+        mFd = -1;
+        return -EIO;
+    }
+
+    mOffset = sizeof(header);
+
+    int err = pthread_create(&mThread, NULL, writerThread, this);
+    if (err) {
+        ::close(mFd);
+        mFd = -1;
+        return -err;
+    }
+    mThreadStarted = true;
+
+    return 0;
+}
+
+int SensorTraceWriter::addDevice(const char* name)
+{
+    int id;
+
+    pthread_mutex_lock(&mLock);
+
+    for (id = 0; id < mNumDevices; id++) {
+        if (!strncmp(mDevices[id].name, name, DEVICE_NAME_MAX - 1))
+            break;
+    }
+
+    if (id == mNumDevices && id < SENSOR_TRACE_MAX_DEVICES) {
+        // devices added midway start with the next block
+        flushBlock();
+        strncpy(mDevices[id].name, name, DEVICE_NAME_MAX - 1);
+        mNumDevices++;
+    }
+
+    pthread_mutex_unlock(&mLock);
+
+    return id < SENSOR_TRACE_MAX_DEVICES ? id : -ENOSPC;
+}
+
+void SensorTraceWriter::encodeFrame(Device* device, const input_event* events,
+        size_t count, int64_t time, bool terminated)
+{
+    if (mBlockSize + MAX_FRAME_BYTES > BLOCK_SIZE ||
+            (mBlockFrames && time - mBlockStart > BLOCK_SPAN_US))
+        flushBlock();
+
+    bool layout = count != device->layoutSize;
+    for (size_t i = 0; !layout && i < count; i++)
+        layout = events[i].type != device->types[i] || events[i].code != device->codes[i];
+
+    uint8_t* p = mBlock + mBlockSize;
+    *p++ = uint8_t(device - mDevices) |
+            (layout ? FRAME_LAYOUT : 0) | (terminated ? 0 : FRAME_UNTERMINATED);
+    p = putVarint(p, zigzag(time - device->time));
+    device->time = time;
+
+    if (layout) {
+        p = putVarint(p, count);
+        for (size_t i = 0; i < count; i++) {
+            *p++ = uint8_t(events[i].type);
+            p = putVarint(p, events[i].code);
+            device->types[i] = events[i].type;
+            device->codes[i] = events[i].code;
+        }
+        device->layoutSize = count;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        p = putVarint(p, zigzag(int64_t(events[i].value) - device->values[i]));
+        device->values[i] = events[i].value;
+    }
+
+    if (!mBlockFrames)
+        mBlockStart = time;
+    mBlockEnd = time;
+    mBlockFrames++;
+    mBlockSize = p - mBlock;
+}
+
+void SensorTraceWriter::write(int id, const input_event* events, size_t count)
+{
+    if (id < 0 || id >= mNumDevices)
+        return;
+
+    Device* const device(&mDevices[id]);
+
+    pthread_mutex_lock(&mLock);
+
+    bool failed = android_atomic_acquire_load(&mFailed);
+    for (size_t i = 0; i < count && mFd >= 0 && !failed; i++) {
+        if (events[i].type == EV_SYN && events[i].code == SYN_REPORT) {
+            // the SYN_REPORT is implied, its time is the frame's
+            encodeFrame(device, device->pending, device->numPending,
+                    eventTime(events[i]), true);
+            device->numPending = 0;
+            continue;
+        }
+
+        device->pending[device->numPending++] = events[i];
+        if (device->numPending == SENSOR_TRACE_MAX_FRAME) {
+            encodeFrame(device, device->pending, device->numPending,
+                    eventTime(events[i]), false);
+            device->numPending = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&mLock);
+}
+
+/*
+ * Hands the current block to the writer thread and starts the next one
+ */
+int SensorTraceWriter::flushBlock()
+{
+    block_header header;
+    int err = 0;
+
+    if (!mBlockFrames || mFd < 0)
+        return 0;
+
+    pthread_mutex_lock(&mQueueLock);
+
+    if (android_atomic_acquire_load(&mFailed)) {
+        err = -EIO;
+    } else if (mQueueCount == SENSOR_TRACE_QUEUE) {
+        ALOGW_IF(!mDropped, "trace writes fall behind, dropping blocks");
+        mDropped++;
+        err = -EAGAIN;
+    } else {
+        int slot = (mQueueHead + mQueueCount) % SENSOR_TRACE_QUEUE;
+        uint8_t* const start = mQueue + slot * QUEUE_SLOT_SIZE;
+        uint8_t* p = start + sizeof(header);
+
+        for (int i = 0; i < mNumDevices; i++) {
+            size_t len = strlen(mDevices[i].name);
+            *p++ = uint8_t(len);
+            memcpy(p, mDevices[i].name, len);
+            p += len;
+        }
+        memcpy(p, mBlock, mBlockSize);
+        p += mBlockSize;
+
+        header.magic = BLOCK_MAGIC;
+        header.size = p - start - sizeof(header);
+        header.frames = mBlockFrames;
+        header.devices = mNumDevices;
+        header.firstTime = mBlockStart;
+        header.lastTime = mBlockEnd;
+        memcpy(start, &header, sizeof(header));
+
+        mQueueSizes[slot] = p - start;
+        mQueueCount++;
+        pthread_cond_signal(&mQueueCond);
+    }
+
+    pthread_mutex_unlock(&mQueueLock);
+
+    if (!err && mIndexSize == mIndexCapacity) {
+        size_t capacity = mIndexCapacity ? mIndexCapacity * 2 : 64;
+        trace_index_entry* index = static_cast<trace_index_entry*>(
+                realloc(mIndex, capacity * sizeof(trace_index_entry)));
+        if (index) {
+            mIndex = index;
+            mIndexCapacity = capacity;
+        }
+    }
+    if (!err && mIndexSize < mIndexCapacity) {
+        mIndex[mIndexSize].offset = mOffset;
+        mIndex[mIndexSize].firstTime = mBlockStart;
+        mIndex[mIndexSize].lastTime = mBlockEnd;
+        mIndexSize++;
+    }
+
+    if (!err)
+        mOffset += sizeof(header) + header.size;
+    mBlockSize = 0;
+    mBlockFrames = 0;
+
+    for (int i = 0; i < mNumDevices; i++) {
+        mDevices[i].layoutSize = 0;
+        memset(mDevices[i].values, 0, sizeof(mDevices[i].values));
+        mDevices[i].time = 0;
+    }
+
+    // a dropped block only leaves a gap
+    return err == -EAGAIN ? 0 : err;
+}
+
+int SensorTraceWriter::close()
+{
+    int err = 0;
+
+    pthread_mutex_lock(&mLock);
+
+    if (mFd < 0) {
+        pthread_mutex_unlock(&mLock);
+        return 0;
+    }
+
+    for (int i = 0; i < mNumDevices; i++) {
+        Device* const device(&mDevices[i]);
+        if (device->numPending)
+            encodeFrame(device, device->pending, device->numPending,
+                    eventTime(device->pending[device->numPending - 1]), false);
+        device->numPending = 0;
+    }
+    err = flushBlock();
+
+    // the writer thread is done once the queue is empty
+    if (mThreadStarted) {
+        pthread_mutex_lock(&mQueueLock);
+        mStop = true;
+        pthread_cond_signal(&mQueueCond);
+        pthread_mutex_unlock(&mQueueLock);
+        pthread_join(mThread, NULL);
+        mThreadStarted = false;
+    }
+    if (!err && android_atomic_acquire_load(&mFailed))
+        err = -EIO;
+
+    ALOGW_IF(mDropped, "%u trace blocks dropped", mDropped);
+
+    if (!err) {
+        uint32_t index[2] = { INDEX_MAGIC, uint32_t(mIndexSize) };
+        trailer end;
+
+        end.indexOffset = mOffset;
+        memcpy(end.magic, TRAILER_MAGIC, sizeof(end.magic));
+
+        struct iovec iov[3];
+        iov[0].iov_base = index;
+        iov[0].iov_len = sizeof(index);
+        iov[1].iov_base = mIndex;
+        iov[1].iov_len = mIndexSize * sizeof(trace_index_entry);
+        iov[2].iov_base = &end;
+        iov[2].iov_len = sizeof(end);
+
+        ssize_t total = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+        if (writev(mFd, iov, 3) != total)
+            err = -EIO;
+    }
+
+    ::close(mFd);
+    mFd = -1;
+
+    pthread_mutex_unlock(&mLock);
+
+    return err;
+}
+
+static SensorTraceWriter* createWriter()
+{
+    char value[PROPERTY_VALUE_MAX];
+    char old[PATH_MAX];
+    const char* path = getenv("SENSORS_TRACE");
+
+    if (path == NULL) {
+        property_get("persist.sensors.trace", value, "");
+        path = value;
+    }
+
+    if (!path[0])
+        return NULL;
+
+    // keep the trace of the previous run
+    snprintf(old, sizeof(old), "%s.old", path);
+    rename(path, old);
+
+    SensorTraceWriter* writer = new SensorTraceWriter();
+    if (writer->open(path) < 0) {
+        delete writer;
+        return NULL;
+    }
+
+    ALOGI("tracing the input devices to %s", path);
+    return writer;
+}
+
+SensorTraceWriter* SensorTraceWriter::get()
+{
+    static SensorTraceWriter* const sWriter = createWriter();
+    return sWriter;
+}
+
+/*****************************************************************************/
+
+struct SensorTraceReader::Block {
+    uint8_t* data;
+    const uint8_t* pos;
+    const uint8_t* end;
+
+    char names[SENSOR_TRACE_MAX_DEVICES][DEVICE_NAME_MAX];
+    int numDevices;
+
+    // delta state of every device
+    size_t layoutSize[SENSOR_TRACE_MAX_DEVICES];
+    uint16_t types[SENSOR_TRACE_MAX_DEVICES][SENSOR_TRACE_MAX_FRAME];
+    uint16_t codes[SENSOR_TRACE_MAX_DEVICES][SENSOR_TRACE_MAX_FRAME];
+    int32_t values[SENSOR_TRACE_MAX_DEVICES][SENSOR_TRACE_MAX_FRAME];
+    int64_t time[SENSOR_TRACE_MAX_DEVICES];
+};
+
+SensorTraceReader::SensorTraceReader()
+    : mFd(-1),
+    mBlock(new Block),
+    mNextOffset(0)
+{
+    memset(mBlock, 0, sizeof(*mBlock));
+}
+
+SensorTraceReader::~SensorTraceReader()
+{
+    if (mFd >= 0)
+        close(mFd);
+    free(mBlock->data);
+    delete mBlock;
+}
+
+bool SensorTraceReader::probe(const char* path)
+{
+    file_header header;
+
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    bool trace = read(fd, &header, sizeof(header)) == sizeof(header) &&
+            !memcmp(header.magic, SENSOR_TRACE_MAGIC, sizeof(header.magic));
+    close(fd);
+
+    return trace;
+}
+
+int SensorTraceReader::open(const char* path)
+{
+    file_header header;
+
+    mFd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (mFd < 0)
+        return -errno;
+
+    if (read(mFd, &header, sizeof(header)) != sizeof(header) ||
+            memcmp(header.magic, SENSOR_TRACE_MAGIC, sizeof(header.magic)) ||
+            header.version != SENSOR_TRACE_VERSION)
+        return -EINVAL;
+
+    mNextOffset = sizeof(header);
+    return 0;
+}
+
+// loads the block at offset, returns 0 past the last one
+int SensorTraceReader::readBlock(int64_t offset)
+{
+    Block* const block(mBlock);
+    block_header header;
+
+    if (pread(mFd, &header, sizeof(header), offset) != sizeof(header) ||
+            header.magic != BLOCK_MAGIC)
+        return 0;
+
+    uint8_t* data = static_cast<uint8_t*>(realloc(block->data, header.size));
+    if (data == NULL)
+        return -ENOMEM;
+    block->data = data;
+
+    if (pread(mFd, data, header.size, offset + sizeof(header)) != ssize_t(header.size))
+        return 0;
+
+    const uint8_t* p = data;
+    const uint8_t* const end = data + header.size;
+
+    block->numDevices = 0;
+    for (uint32_t i = 0; i < header.devices && i < SENSOR_TRACE_MAX_DEVICES; i++) {
+        size_t len = p < end ? *p++ : 0;
+        if (len >= DEVICE_NAME_MAX || p + len > end)
+            return -EINVAL;
+        memcpy(block->names[i], p, len);
+        block->names[i][len] = '\0';
+        p += len;
+        block->numDevices++;
+    }
+
+    block->pos = p;
+    block->end = end;
+    memset(block->layoutSize, 0, sizeof(block->layoutSize));
+    memset(block->values, 0, sizeof(block->values));
+    memset(block->time, 0, sizeof(block->time));
+
+    mNextOffset = offset + sizeof(header) + header.size;
+    return 1;
+}
+
+int SensorTraceReader::seek(int64_t timeUs)
+{
+    trailer end;
+    int64_t offset = sizeof(file_header);
+
+    if (mFd < 0)
+        return -EBADF;
+
+    // use the index of a closed trace, else walk the block headers
+    off_t size = lseek(mFd, 0, SEEK_END);
+    if (size >= off_t(sizeof(end)) &&
+            pread(mFd, &end, sizeof(end), size - sizeof(end)) == sizeof(end) &&
+            !memcmp(end.magic, TRAILER_MAGIC, sizeof(end.magic))) {
+        uint32_t index[2];
+        if (pread(mFd, index, sizeof(index), end.indexOffset) == sizeof(index) &&
+                index[0] == INDEX_MAGIC) {
+            for (uint32_t i = 0; i < index[1]; i++) {
+                trace_index_entry entry;
+                if (pread(mFd, &entry, sizeof(entry),
+                            end.indexOffset + sizeof(index) + i * sizeof(entry)) != sizeof(entry))
+                    break;
+                offset = entry.offset;
+                if (entry.lastTime >= timeUs)
+                    break;
+            }
+        }
+    } else {
+        block_header header;
+        while (pread(mFd, &header, sizeof(header), offset) == sizeof(header) &&
+                header.magic == BLOCK_MAGIC && header.lastTime < timeUs)
+            offset += sizeof(header) + header.size;
+    }
+
+    mBlock->pos = mBlock->end = NULL;
+    mNextOffset = offset;
+    return 0;
+}
+
+int SensorTraceReader::next(const char** device, input_event* events, size_t size)
+{
+    Block* const block(mBlock);
+    uint64_t v;
+
+    if (mFd < 0)
+        return -EBADF;
+
+    while (block->pos == block->end) {
+        int err = readBlock(mNextOffset);
+        if (err <= 0)
+            return err;
+    }
+
+    const uint8_t* p = block->pos;
+    const uint8_t* const end = block->end;
+
+    const uint8_t flags = *p++;
+    const int id = flags & FRAME_DEVICE_MASK;
+    if (id >= block->numDevices || !(p = getVarint(p, end, &v)))
+        return -EINVAL;
+
+    const int64_t time = block->time[id] + unzigzag(v);
+    block->time[id] = time;
+
+    if (flags & FRAME_LAYOUT) {
+        if (!(p = getVarint(p, end, &v)) || v > SENSOR_TRACE_MAX_FRAME)
+            return -EINVAL;
+        block->layoutSize[id] = v;
+        for (size_t i = 0; i < v; i++) {
+            if (p == end)
+                return -EINVAL;
+            block->types[id][i] = *p++;
+            uint64_t code;
+            if (!(p = getVarint(p, end, &code)))
+                return -EINVAL;
+            block->codes[id][i] = uint16_t(code);
+        }
+    }
+
+    const size_t count = block->layoutSize[id];
+    const bool terminated = !(flags & FRAME_UNTERMINATED);
+    if (count + terminated > size)
+        return -ENOSPC;
+
+    for (size_t i = 0; i < count + terminated; i++) {
+        input_event* const event(&events[i]);
+
+        memset(event, 0, sizeof(*event));
+        event->time.tv_sec = time / 1000000LL;
+        event->time.tv_usec = time % 1000000LL;
+
+        if (i == count) {
+            event->type = EV_SYN;
+            event->code = SYN_REPORT;
+            break;
+        }
+
+        if (!(p = getVarint(p, end, &v)))
+            return -EINVAL;
+        block->values[id][i] += int32_t(unzigzag(v));
+        event->type = block->types[id][i];
+        event->code = block->codes[id][i];
+        event->value = block->values[id][i];
+    }
+
+    block->pos = p;
+    *device = block->names[id];
+    return count + terminated;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_TRACE_H
+#define ANDROID_SENSOR_TRACE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+/*
+ * Compact recording of raw input event streams.
+ *
+ * The file starts with the 8 byte magic "SNSTRACE" and a version, then
+ * holds blocks. Every block decodes on its own: a header with its size,
+ * frame count and time span, the names of the devices it refers to,
+ * then the frames. A frame is the events of one device up to its
+ * SYN_REPORT, which is implied:
+ *
+ *   u8       device (bits 0-3), layout follows (bit 4), no SYN_REPORT (bit 5)
+ *   varint   zigzag timestamp delta to the device's previous frame, in us
+ *   [varint  event count, then u8 type and varint code per event]
+ *   varint   zigzag value delta to the device's previous frame, per event
+ *
+ * The layout is only written when the event types and codes change, and
+ * all deltas restart at 0 with every block. A closed trace ends with an
+ * index of the block offsets and times; a trace cut short by a crash is
+ * still read by walking the block headers.
+ *
+ * All integers are little endian.
+ */
+
+#define SENSOR_TRACE_MAGIC          "SNSTRACE"
+#define SENSOR_TRACE_VERSION        1
+#define SENSOR_TRACE_MAX_DEVICES    16
+#define SENSOR_TRACE_MAX_FRAME      16
+#define SENSOR_TRACE_QUEUE          4
+
+struct input_event;
+struct trace_index_entry;
+
+/*
+ * Appends the events read from the input devices to a trace. Enabled by
+ * setting the SENSORS_TRACE environment variable or the
+ * persist.sensors.trace property to a file name; a previous trace of the
+ * same name is kept as <name>.old.
+ */
+class SensorTraceWriter {
+    struct Device;
+
+    pthread_mutex_t mLock;
+    int mFd;
+    int64_t mOffset;
+
+    Device* mDevices;
+    int mNumDevices;
+
+    uint8_t* mBlock;
+    size_t mBlockSize;
+    uint32_t mBlockFrames;
+    int64_t mBlockStart;
+    int64_t mBlockEnd;
+
+    trace_index_entry* mIndex;
+    size_t mIndexSize;
+    size_t mIndexCapacity;
+
+    // Finished blocks wait in a ring for the writer thread, so that the
+    // poll thread never blocks on the file. A block finding the ring
+    // full is dropped, the others still decode.
+    pthread_t mThread;
+    bool mThreadStarted;
+    pthread_mutex_t mQueueLock;
+    pthread_cond_t mQueueCond;
+    uint8_t* mQueue;
+    size_t mQueueSizes[SENSOR_TRACE_QUEUE];
+    int mQueueHead;
+    int mQueueCount;
+    bool mStop;
+    volatile int32_t mFailed;
+    uint32_t mDropped;
+
+    void encodeFrame(Device* device, const input_event* events, size_t count,
+            int64_t time, bool terminated);
+    int flushBlock();
+    void writeQueue();
+    static void* writerThread(void* arg);
+
+public:
+            SensorTraceWriter();
+            ~SensorTraceWriter();
+
+    int open(const char* path);
+    // writes the last block and the index
+    int close();
+
+    // id of a device in the trace, or a negative errno
+    int addDevice(const char* name);
+    // events as read from the device, frames may be cut anywhere
+    void write(int device, const input_event* events, size_t count);
+
+    // trace of this process, NULL when tracing is off
+    static SensorTraceWriter* get();
+};
+
+/*
+ * Reads a trace back a frame at a time.
+ */
+class SensorTraceReader {
+    struct Block;
+
+    int mFd;
+    Block* mBlock;
+    int64_t mNextOffset;
+
+    int readBlock(int64_t offset);
+
+public:
+            SensorTraceReader();
+            ~SensorTraceReader();
+
+    int open(const char* path);
+
+    // continue at the first block that ends at or after timeUs
+    int seek(int64_t timeUs);
+
+    // the events of the next frame, SYN_REPORT included. Returns their
+    // count, 0 at the end of the trace or a negative errno; device points
+    // to the name of the device.
+    int next(const char** device, input_event* events, size_t size);
+
+    // whether path holds a trace
+    static bool probe(const char* path);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_TRACE_H
@@ -0,0 +1,602 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SimulatedBackend"
+
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <cstring>
+
+#include <cutils/log.h>
+
+#include <linux/input.h>
+
+#include "SimulatedBackend.h"
+#include "SensorTrace.h"
+
+/*****************************************************************************/
+
+// the attributes are read back at most this often
+#define SIM_ATTRIBUTE_CHECK_NS  10000000LL
+// a thread this late skips samples instead of catching up
+#define SIM_MAX_LAG_NS          100000000LL
+// shortest step between two trace samples
+#define SIM_MIN_TRACE_STEP_NS   100000LL
+
+enum {
+    SIM_ACCELERATION,
+    SIM_MAGNETIC,
+    SIM_LIGHT,
+    SIM_PROXIMITY,
+};
+
+struct SimDevice {
+    const char* name;
+    int kind;
+    int type;
+    int codes[3];
+    int numCodes;
+    const char* delayAttribute;
+    int64_t delayUnit;          // ns per unit of the delay attribute
+    int64_t defaultPeriod;
+    bool onChange;              // only transitions are reported
+    const char* defaultSource;
+};
+
+static const SimDevice sDevices[] = {
+    { "accelerometer", SIM_ACCELERATION, EV_ABS, { ABS_X, ABS_Y, ABS_Z }, 3,
+        "delay", 1000000LL, 200000000LL, false, "rotation" },
+    { "geomagnetic", SIM_MAGNETIC, EV_ABS, { ABS_X, ABS_Y, ABS_Z }, 3,
+        "delay", 1000000LL, 200000000LL, false, "rotation" },
+    { "light_sensor", SIM_LIGHT, EV_REL, { EVENT_TYPE_LIGHT }, 1,
+        "poll_delay", 1LL, 200000000LL, false, "ramp" },
+    { "proximity_sensor", SIM_PROXIMITY, EV_ABS, { EVENT_TYPE_PROXIMITY }, 1,
+        NULL, 0, 50000000LL, true, "toggle" },
+};
+
+enum {
+    SOURCE_STILL,
+    SOURCE_ROTATION,
+    SOURCE_SHAKE,
+    SOURCE_RAMP,
+    SOURCE_TOGGLE,
+    SOURCE_TRACE,
+};
+
+static const char* const sSourceNames[] = {
+    "still",
+    "rotation",
+    "shake",
+    "ramp",
+    "toggle",
+};
+
+struct TraceSample {
+    double time;
+    int values[3];
+};
+
+struct SimContext {
+    const SimDevice* device;
+    int source;
+    int64_t forcedPeriod;       // from @<hz>, 0 to follow the delay attribute
+    int fd;
+    int enableFd;
+    int delayFd;
+    uint32_t seed;
+
+    TraceSample* trace;
+    size_t traceSize;
+    size_t traceIndex;
+};
+
+// raw values of the device lying flat: 1 g is 256, the field is in nT
+static const double sGravity[3] = { 0, 0, 256 };
+static const double sField[3] = { 0, 22000, -40000 };
+
+static int64_t clockNs(clockid_t clock)
+{
+    struct timespec t;
+    t.tv_sec = t.tv_nsec = 0;
+    clock_gettime(clock, &t);
+    return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+}
+
+static void sleepUntil(int64_t ns)
+{
+    struct timespec t;
+    t.tv_sec = ns / 1000000000LL;
+    t.tv_nsec = ns % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR)
+        ;
+}
+
+static const SimDevice* findDevice(const char* name)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(sDevices); i++) {
+        if (!strcmp(sDevices[i].name, name))
+            return &sDevices[i];
+    }
+    return NULL;
+}
+
+// uniform in [-1, 1]
+static double noise(uint32_t* seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return ((*seed >> 16) & 0x7fff) / 16383.5 - 1.0;
+}
+
+// world vector seen by a device turned by yaw about the vertical, then
+// tilted by pitch about its x axis
+static void orient(const double world[3], double yaw, double pitch, double out[3])
+{
+    double x = world[0] * cos(yaw) + world[1] * sin(yaw);
+    double y = -world[0] * sin(yaw) + world[1] * cos(yaw);
+    double z = world[2];
+
+    out[0] = x;
+    out[1] = y * cos(pitch) + z * sin(pitch);
+    out[2] = -y * sin(pitch) + z * cos(pitch);
+}
+
+static void generate(SimContext* ctx, double t, int values[3])
+{
+    const int kind = ctx->device->kind;
+    double v[3] = { 0, 0, 0 };
+
+    switch (kind) {
+        case SIM_ACCELERATION:
+        case SIM_MAGNETIC: {
+            const double* world = kind == SIM_ACCELERATION ? sGravity : sField;
+            double yaw = 0, pitch = 0;
+
+            if (ctx->source == SOURCE_ROTATION) {
+                yaw = 2 * M_PI * 0.1 * t;
+                pitch = 0.5 * sin(2 * M_PI * 0.25 * t);
+            }
+            orient(world, yaw, pitch, v);
+
+            if (ctx->source == SOURCE_SHAKE && kind == SIM_ACCELERATION) {
+                v[0] += 205 * sin(2 * M_PI * 5 * t);
+                v[1] += 128 * sin(2 * M_PI * 5 * t + 1);
+                for (int i = 0; i < 3; i++)
+                    v[i] += 8 * noise(&ctx->seed);
+            } else if (ctx->source == SOURCE_SHAKE) {
+                for (int i = 0; i < 3; i++)
+                    v[i] += 300 * noise(&ctx->seed);
+            }
+            break;
+        }
+        case SIM_LIGHT: {
+            v[0] = 300;
+            if (ctx->source == SOURCE_RAMP) {
+                // up and down in 10 s, lingering in the dark
+                double u = fabs(fmod(t, 10.0) / 5.0 - 1.0);
+                v[0] = 1023 * u * u;
+            } else if (ctx->source == SOURCE_SHAKE) {
+                v[0] += 20 * noise(&ctx->seed);
+            }
+            break;
+        }
+        case SIM_PROXIMITY:
+            v[0] = ctx->source == SOURCE_TOGGLE && (int64_t(t / 2) & 1) ? 0 : 1;
+            break;
+    }
+
+    for (int i = 0; i < 3; i++)
+        values[i] = int(lround(v[i]));
+}
+
+// next trace sample, returns the time to the one after it
+static int64_t replay(SimContext* ctx, int values[3])
+{
+    const TraceSample* sample(&ctx->trace[ctx->traceIndex]);
+    int64_t step;
+
+    memcpy(values, sample->values, sizeof(sample->values));
+
+    if (ctx->traceIndex + 1 < ctx->traceSize) {
+        step = int64_t((sample[1].time - sample[0].time) * 1e9);
+        ctx->traceIndex++;
+    } else {
+        // loop, the last step is repeated
+        step = ctx->traceSize > 1 ?
+                int64_t((sample[0].time - sample[-1].time) * 1e9) :
+                ctx->device->defaultPeriod;
+        ctx->traceIndex = 0;
+    }
+
+    return step < SIM_MIN_TRACE_STEP_NS ? SIM_MIN_TRACE_STEP_NS : step;
+}
+
+static int64_t readAttribute(int fd)
+{
+    char buf[32];
+
+    if (fd < 0)
+        return 0;
+
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    return strtoll(buf, NULL, 10);
+}
+
+static int64_t samplePeriod(const SimContext* ctx)
+{
+    if (ctx->forcedPeriod)
+        return ctx->forcedPeriod;
+
+    int64_t delay = readAttribute(ctx->delayFd) * ctx->device->delayUnit;
+    return delay > 0 ? delay : ctx->device->defaultPeriod;
+}
+
+static int writeFrame(const SimContext* ctx, const int values[3])
+{
+    const SimDevice* device = ctx->device;
+    struct input_event frame[4];
+    int64_t now = clockNs(CLOCK_BOOTTIME);
+
+    memset(frame, 0, sizeof(frame));
+    for (int i = 0; i <= device->numCodes; i++) {
+        frame[i].time.tv_sec = now / 1000000000LL;
+        frame[i].time.tv_usec = (now % 1000000000LL) / 1000;
+        if (i < device->numCodes) {
+            frame[i].type = device->type;
+            frame[i].code = device->codes[i];
+            frame[i].value = values[i];
+        } else {
+            frame[i].type = EV_SYN;
+            frame[i].code = SYN_REPORT;
+        }
+    }
+
+    // the socket blocks, so frames are never cut short
+    const char* p = reinterpret_cast<const char*>(frame);
+    size_t left = (device->numCodes + 1) * sizeof(frame[0]);
+    while (left) {
+        ssize_t n = send(ctx->fd, p, left, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -errno;
+        p += n;
+        left -= n;
+    }
+
+    return 0;
+}
+
+static void* simThread(void* arg)
+{
+    SimContext* ctx = static_cast<SimContext*>(arg);
+    int64_t start = clockNs(CLOCK_MONOTONIC);
+    int64_t next = start;
+    int64_t nextCheck = 0;
+    int64_t period = ctx->device->defaultPeriod;
+    bool enabled = false;
+    bool reported = false;
+    int last[3];
+
+    for (;;) {
+        int64_t now = clockNs(CLOCK_MONOTONIC);
+
+        if (now >= nextCheck) {
+            bool wasEnabled = enabled;
+            enabled = readAttribute(ctx->enableFd) > 0;
+            period = samplePeriod(ctx);
+            nextCheck = now + SIM_ATTRIBUTE_CHECK_NS;
+
+            // like the drivers, report a sample right after enable
+            if (enabled && !wasEnabled) {
+                reported = false;
+                next = now;
+            }
+        }
+
+        if (!enabled || next > now) {
+            sleepUntil(enabled && next < nextCheck ? next : nextCheck);
+            continue;
+        }
+
+        int values[3] = { 0, 0, 0 };
+        int64_t step = period;
+        if (ctx->source != SOURCE_TRACE)
+            generate(ctx, (next - start) / 1e9, values);
+        else if (ctx->forcedPeriod)
+            replay(ctx, values);
+        else
+            step = replay(ctx, values);
+
+        if (!ctx->device->onChange || !reported || memcmp(last, values, sizeof(last))) {
+            if (writeFrame(ctx, values) < 0)
+                break;
+            memcpy(last, values, sizeof(last));
+            reported = true;
+        }
+
+        next += step;
+        if (now - next > SIM_MAX_LAG_NS)
+            next = now;
+    }
+
+    // the HAL closed the device
+    close(ctx->fd);
+    if (ctx->enableFd >= 0)
+        close(ctx->enableFd);
+    if (ctx->delayFd >= 0)
+        close(ctx->delayFd);
+    free(ctx->trace);
+    delete ctx;
+    return NULL;
+}
+
+static bool appendSample(SimContext* ctx, size_t* capacity, const TraceSample& sample)
+{
+    if (ctx->traceSize == *capacity) {
+        size_t size = *capacity ? *capacity * 2 : 256;
+        TraceSample* trace = static_cast<TraceSample*>(
+                realloc(ctx->trace, size * sizeof(TraceSample)));
+        if (trace == NULL)
+            return false;
+        ctx->trace = trace;
+        *capacity = size;
+    }
+
+    ctx->trace[ctx->traceSize++] = sample;
+    return true;
+}
+
+// a trace written by SensorTraceWriter, evdev leaves unchanged axes out
+// of a frame so they keep their last value
+static int loadCompactTrace(SimContext* ctx, const char* path)
+{
+    const SimDevice* device = ctx->device;
+    SensorTraceReader trace;
+    struct input_event events[SENSOR_TRACE_MAX_FRAME + 1];
+    TraceSample sample;
+    size_t capacity = 0;
+    const char* name;
+    int n, err;
+
+    err = trace.open(path);
+    if (err)
+        return err;
+
+    memset(&sample, 0, sizeof(sample));
+    while ((n = trace.next(&name, events, ARRAY_SIZE(events))) > 0) {
+        if (strcmp(name, device->name))
+            continue;
+
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < device->numCodes; j++) {
+                if (events[i].type == device->type && events[i].code == device->codes[j])
+                    sample.values[j] = events[i].value;
+            }
+        }
+        sample.time = events[n - 1].time.tv_sec + events[n - 1].time.tv_usec / 1e6;
+
+        if (!appendSample(ctx, &capacity, sample))
+            break;
+    }
+
+    if (n < 0)
+        return n;
+    return ctx->traceSize ? 0 : -ENODATA;
+}
+
+static int loadTrace(SimContext* ctx, const char* path)
+{
+    char line[256];
+    size_t capacity = 0;
+
+    if (SensorTraceReader::probe(path))
+        return loadCompactTrace(ctx, path);
+
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return -errno;
+
+    while (fgets(line, sizeof(line), f)) {
+        TraceSample sample;
+        char name[64];
+
+        memset(&sample, 0, sizeof(sample));
+        int n = sscanf(line, "%lf %63s %d %d %d", &sample.time, name,
+                &sample.values[0], &sample.values[1], &sample.values[2]);
+        if (n < 2 + ctx->device->numCodes || strcmp(name, ctx->device->name))
+            continue;
+
+        if (!appendSample(ctx, &capacity, sample))
+            break;
+    }
+    fclose(f);
+
+    return ctx->traceSize ? 0 : -ENODATA;
+}
+
+static int parseSource(SimContext* ctx, const char* source)
+{
+    if (!strncmp(source, "trace:", 6)) {
+        ctx->source = SOURCE_TRACE;
+        return loadTrace(ctx, source + 6);
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(sSourceNames); i++) {
+        if (!strcmp(source, sSourceNames[i])) {
+            ctx->source = i;
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+// create the attribute and open it for the thread to read back
+static int createAttribute(const char* name, const char* attr)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), SENSORS_SIM_ROOT "/%s/%s", name, attr);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0660);
+    if (fd < 0) {
+        ALOGE("Couldn't create %s (%s)", path, strerror(errno));
+        return -errno;
+    }
+
+    if (write(fd, "0", 2) < 0) {
+        close(fd);
+        return -errno;
+    }
+    return fd;
+}
+
+/*****************************************************************************/
+
+SimulatedBackend::SimulatedBackend(const char* spec)
+    : mSpec(strdup(spec ? spec : ""))
+{
+}
+
+SimulatedBackend::~SimulatedBackend()
+{
+    free(mSpec);
+}
+
+void SimulatedBackend::lookup(const char* name, char* source, size_t size, int* hz) const
+{
+    const size_t len = strlen(name);
+    const char* entry = mSpec;
+
+    *hz = 0;
+    snprintf(source, size, "%s", findDevice(name)->defaultSource);
+
+    while (entry && *entry) {
+        const char* end = strchrnul(entry, ',');
+
+        if (!strncmp(entry, name, len) && entry[len] == '=') {
+            const char* value = entry + len + 1;
+            const char* at = value;
+
+            // the rate is the last @, trace paths may hold others
+            for (const char* p = value; p < end; p++) {
+                if (*p == '@')
+                    at = p;
+            }
+            if (at == value || at[1] < '0' || at[1] > '9')
+                at = end;
+            else
+                *hz = atoi(at + 1);
+
+            snprintf(source, size, "%.*s", int(at - value), value);
+        }
+
+        entry = *end ? end + 1 : NULL;
+    }
+}
+
+int SimulatedBackend::openInput(const char* name, clockid_t* clock)
+{
+    const SimDevice* device = findDevice(name);
+    char source[PATH_MAX];
+    char path[PATH_MAX];
+    int hz, err, fds[2];
+
+    if (device == NULL)
+        return -ENODEV;
+
+    lookup(name, source, sizeof(source), &hz);
+    if (!strcmp(source, "none"))
+        return -ENODEV;
+
+    SimContext* ctx = new SimContext;
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->device = device;
+    ctx->forcedPeriod = hz > 0 ? 1000000000LL / hz : 0;
+    ctx->fd = ctx->enableFd = ctx->delayFd = -1;
+    ctx->seed = device->kind + 1;
+
+    err = parseSource(ctx, source);
+    if (err) {
+        ALOGE("%s: bad source %s (%s)", name, source, strerror(-err));
+        goto error;
+    }
+
+    mkdir(SENSORS_SIM_ROOT, 0770);
+    snprintf(path, sizeof(path), SENSORS_SIM_ROOT "/%s", name);
+    mkdir(path, 0770);
+
+    ctx->enableFd = err = createAttribute(name, "enable");
+    if (err < 0)
+        goto error;
+    if (device->delayAttribute) {
+        ctx->delayFd = err = createAttribute(name, device->delayAttribute);
+        if (err < 0)
+            goto error;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        err = -errno;
+        goto error;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    ctx->fd = fds[1];
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    err = -pthread_create(&thread, &attr, simThread, ctx);
+    pthread_attr_destroy(&attr);
+    if (err) {
+        close(fds[0]);
+        goto error;
+    }
+
+    ALOGI_IF(hz > 0, "%s: simulated from %s at %d Hz", name, source, hz);
+    ALOGI_IF(hz <= 0, "%s: simulated from %s", name, source);
+    *clock = CLOCK_BOOTTIME;
+    return fds[0];
+
+error:
+    if (ctx->fd >= 0)
+        close(ctx->fd);
+    if (ctx->enableFd >= 0)
+        close(ctx->enableFd);
+    if (ctx->delayFd >= 0)
+        close(ctx->delayFd);
+    free(ctx->trace);
+    delete ctx;
+    return err;
+}
+
+int SimulatedBackend::attributePath(const char* name, char* path, size_t size)
+{
+    if (findDevice(name) == NULL)
+        return -ENODEV;
+
+    if (snprintf(path, size, SENSORS_SIM_ROOT "/%s/", name) >= int(size))
+        return -ENAMETOOLONG;
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SIMULATED_BACKEND_H
+#define ANDROID_SIMULATED_BACKEND_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+#include "SensorBackend.h"
+
+/*****************************************************************************/
+
+#ifndef SENSORS_SIM_ROOT
+#define SENSORS_SIM_ROOT "/data/sensors/sim"
+#endif
+
+/*
+ * Generates the accelerometer, geomagnetic, light_sensor and
+ * proximity_sensor input devices. Every opened device gets a thread
+ * writing struct input_event frames, stamped with CLOCK_BOOTTIME, to a
+ * socket the HAL reads like an evdev node. The enable/delay attributes
+ * are plain files under SENSORS_SIM_ROOT/<device>/ that the thread reads
+ * back, so it runs at the rate the HAL asked for, like the drivers.
+ *
+ * The spec is a comma separated list of <device>=<source>[@<hz>]:
+ *
+ *   still          device lying flat, facing north
+ *   rotation       spinning about the vertical while rocking back and forth
+ *   shake          still with a 5 Hz shake and noise on top
+ *   ramp           light going up and down between dark and bright
+ *   toggle         proximity switching between near and far every 2 s
+ *   trace:<path>   looped replay of a SensorTrace recording, or of the
+ *                  <device> lines of a text trace:
+ *                  <seconds> <device> <raw value>...
+ *
+ * @<hz> overrides the delay attribute, running the device at rates well
+ * beyond what the drivers allow. Devices not in the spec use rotation,
+ * ramp and toggle; "<device>=none" removes one.
+ */
+class SimulatedBackend : public SensorBackend {
+    char* mSpec;
+
+    void lookup(const char* name, char* source, size_t size, int* hz) const;
+
+public:
+            SimulatedBackend(const char* spec);
+    virtual ~SimulatedBackend();
+
+    virtual int openInput(const char* name, clockid_t* clock);
+    virtual int attributePath(const char* name, char* path, size_t size);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SIMULATED_BACKEND_H
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TimestampFilter.h"
+
+/*****************************************************************************/
+
+// The period estimate moves by 1/PERIOD_GAIN and the phase by
+// 1/PHASE_GAIN of the measured error at each sample
+#define PERIOD_GAIN     16
+#define PHASE_GAIN      8
+
+TimestampFilter::TimestampFilter()
+{
+    reset();
+}
+
+void TimestampFilter::reset()
+{
+    mPeriod = 0;
+    mLast = 0;
+    mFiltered = 0;
+}
+
+int64_t TimestampFilter::filter(int64_t timestamp)
+{
+    int64_t delta = timestamp - mLast;
+
+    if (!mLast || delta <= 0) {
+        mLast = timestamp;
+        mFiltered = timestamp > mFiltered ? timestamp : mFiltered + 1;
+        return mFiltered;
+    }
+    mLast = timestamp;
+
+    // first interval, missed samples or a new rate: start over from here
+    if (!mPeriod || delta > 2 * mPeriod || delta < mPeriod / 2) {
+        mPeriod = delta;
+        mFiltered = timestamp > mFiltered ? timestamp : mFiltered + 1;
+        return mFiltered;
+    }
+
+    mPeriod += (delta - mPeriod) / PERIOD_GAIN;
+
+    int64_t predicted = mFiltered + mPeriod;
+    int64_t filtered = predicted + (timestamp - predicted) / PHASE_GAIN;
+
+    if (filtered > timestamp)
+        filtered = timestamp;
+    if (filtered <= mFiltered)
+        filtered = mFiltered + 1;
+
+    mFiltered = filtered;
+    return filtered;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_TIMESTAMP_FILTER_H
+#define ANDROID_TIMESTAMP_FILTER_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+/*****************************************************************************/
+
+/*
+ * Smooths the timestamps of a periodic sensor. The driver stamps samples
+ * when its work item runs, so they carry scheduling jitter; the filter
+ * tracks the actual sample period and phase and reports timestamps on
+ * that grid. Gaps and rate changes restart the estimate. Timestamps are
+ * never moved later than the raw ones and always increase.
+ */
+class TimestampFilter
+{
+    int64_t mPeriod;
+    int64_t mLast;
+    int64_t mFiltered;
+
+public:
+    TimestampFilter();
+    void reset();
+    int64_t filter(int64_t timestamp);
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_TIMESTAMP_FILTER_H
@@ -30,6 +30,7 @@
 #include <utils/Log.h>
 
 #include "geomagneticd.h"
+#include "input_index.h"
 
 // This geomagnetic daemon is in charge of finding the correct calibration
 // offsets to apply to the YAS530 magnetic field sensor.
@@ -351,11 +352,71 @@ int geomagneticd_calib_offsets(struct geomagneticd_data *data)
 	return 0;
 }
 
+int geomagneticd_event(struct geomagneticd_data *data,
+	struct input_event *input_event)
+{
+	int rc;
+
+	if (data == NULL || input_event == NULL)
+		return -EINVAL;
+
+	// Update the extrema from the current value
+	if(input_event->type == EV_ABS) {
+		switch (input_event->code) {
+			case ABS_X:
+				geomagneticd_magnetic_extrema(data, 0, input_event->value);
+				break;
+			case ABS_Y:
+				geomagneticd_magnetic_extrema(data, 1, input_event->value);
+				break;
+			case ABS_Z:
+				geomagneticd_magnetic_extrema(data, 2, input_event->value);
+				break;
+		}
+	}
+
+	if (input_event->type == EV_SYN) {
+		// Sometimes, the hard offsets cannot be read at startup
+		// so we need to do it now
+		if (!geomagneticd_offsets_check(data)) {
+			rc = geomagneticd_offsets_read(data);
+			if (rc < 0) {
+				ALOGE("%s: Unable to read offsets", __func__);
+				return -1;
+			}
+
+			// Most likely, the calib offset will be invalid
+			if (geomagneticd_offsets_check(data)) {
+				data->accuracy = 1;
+				geomagneticd_magnetic_extrema_init(data);
+			}
+
+			rc = geomagneticd_config_write(data);
+			if (rc < 0) {
+				ALOGE("%s: Unable to write config", __func__);
+				return -1;
+			}
+		}
+
+		data->count++;
+
+		rc = geomagneticd_calib_offsets(data);
+		if (rc < 0) {
+			ALOGE("%s: Unable to calib offsets", __func__);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 int geomagneticd_poll(struct geomagneticd_data *data)
 {
-	struct input_event input_event;
+	struct input_event input_events[GEOMAGNETICD_EVENTS_MAX];
 	struct pollfd poll_fd;
+	int count;
 	int rc;
+	int i;
 
 	if (data == NULL)
 		return -EINVAL;
@@ -379,58 +440,16 @@ int geomagneticd_poll(struct geomagneticd_data *data)
 
 		poll_fd.revents = 0;
 
-		rc = read(data->input_fd, &input_event, sizeof(input_event));
-		if (rc < (int) sizeof(input_event)) {
+		// Read whatever is queued at once
+		rc = read(data->input_fd, input_events, sizeof(input_events));
+		if (rc < (int) sizeof(struct input_event)) {
 			ALOGE("%s: Unable to read input event", __func__);
 			continue;
 		}
 
-		// Update the extrema from the current value
-		if(input_event.type == EV_ABS) {
-			switch (input_event.code) {
-				case ABS_X:
-					geomagneticd_magnetic_extrema(data, 0, input_event.value);
-					break;
-				case ABS_Y:
-					geomagneticd_magnetic_extrema(data, 1, input_event.value);
-					break;
-				case ABS_Z:
-					geomagneticd_magnetic_extrema(data, 2, input_event.value);
-					break;
-			}
-		}
-
-		if (input_event.type == EV_SYN) {
-			// Sometimes, the hard offsets cannot be read at startup
-			// so we need to do it now
-			if (!geomagneticd_offsets_check(data)) {
-				rc = geomagneticd_offsets_read(data);
-				if (rc < 0) {
-					ALOGE("%s: Unable to read offsets", __func__);
-					continue;
-				}
-
-				// Most likely, the calib offset will be invalid
-				if (geomagneticd_offsets_check(data)) {
-					data->accuracy = 1;
-					geomagneticd_magnetic_extrema_init(data);
-				}
-
-				rc = geomagneticd_config_write(data);
-				if (rc < 0) {
-					ALOGE("%s: Unable to write config", __func__);
-					continue;
-				}
-			}
-
-			data->count++;
-
-			rc = geomagneticd_calib_offsets(data);
-			if (rc < 0) {
-				ALOGE("%s: Unable to calib offsets", __func__);
-				continue;
-			}
-		}
+		count = rc / sizeof(struct input_event);
+		for (i = 0; i < count; i++)
+			geomagneticd_event(data, &input_events[i]);
 	}
 
 	rc = 0;
@@ -453,13 +472,13 @@ int main(int argc __unused, char *argv[] __unused)
 	geomagneticd_data = (struct geomagneticd_data *)
 		calloc(1, sizeof(struct geomagneticd_data));
 
-	input_fd = input_open("geomagnetic_raw");
+	input_fd = input_index_open("geomagnetic_raw", O_RDONLY | O_NONBLOCK, NULL, 0);
 	if (input_fd < 0) {
 		ALOGE("%s: Unable to open input", __func__);
 		goto error;
 	}
 
-	rc = sysfs_path_prefix("geomagnetic_raw", (char *) &path);
+	rc = input_index_sysfs_path("geomagnetic_raw", (char *) &path, sizeof(path));
 	if (rc < 0 || path[0] == '\0') {
 		ALOGE("%s: Unable to open sysfs", __func__);
 		goto error;
@@ -30,6 +30,9 @@
 #define GEOMAGNETICD_CONFIG_PATH		"/data/sensors/yas.cfg"
 #define GEOMAGNETICD_CONFIG_BACKUP_PATH		"/data/sensors/yas-backup.cfg"
 
+// Events read from the input device per syscall
+#define GEOMAGNETICD_EVENTS_MAX			64
+
 struct geomagneticd_data {
 	int magnetic_extrema[2][3];
 	int hard_offsets[3];
@@ -42,11 +45,4 @@ struct geomagneticd_data {
 	int count;
 };
 
-/*
- * Input
- */
-
-int input_open(char *name);
-int sysfs_path_prefix(char *name, char *path_prefix);
-
 #endif
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#define LOG_TAG "input_index"
+#include <cutils/log.h>
+
+#include "input_index.h"
+
+#define INPUT_INDEX_MAX		32
+#define INPUT_NAME_MAX		80
+#define INPUT_NODE_MAX		16
+
+struct input_index_entry {
+	char name[INPUT_NAME_MAX];
+	char node[INPUT_NODE_MAX];
+};
+
+static struct input_index_entry input_index[INPUT_INDEX_MAX];
+static int input_index_count = -1;
+static pthread_mutex_t input_index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int input_index_read_name(const char *node, char *name)
+{
+	char path[PATH_MAX];
+	ssize_t length;
+	char *c;
+	int fd;
+
+	snprintf(path, sizeof(path), INPUT_SYSFS_PATH "%s/device/name", node);
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	length = read(fd, name, INPUT_NAME_MAX - 1);
+	close(fd);
+	if (length < 0)
+		return -errno;
+
+	name[length] = '\0';
+	c = strchr(name, '\n');
+	if (c != NULL)
+		*c = '\0';
+
+	return 0;
+}
+
+/* Called with input_index_mutex held */
+static void input_index_build(void)
+{
+	struct input_index_entry *entry;
+	struct dirent *di;
+	DIR *d;
+
+	input_index_count = 0;
+
+	d = opendir(INPUT_SYSFS_PATH);
+	if (d == NULL) {
+		ALOGE("%s: Unable to open %s", __func__, INPUT_SYSFS_PATH);
+		return;
+	}
+
+	while ((di = readdir(d)) != NULL && input_index_count < INPUT_INDEX_MAX) {
+		// only event handlers have a node the sensors can be read from
+		if (strncmp(di->d_name, "event", 5) != 0 ||
+			strlen(di->d_name) >= INPUT_NODE_MAX)
+			continue;
+
+		entry = &input_index[input_index_count];
+		if (input_index_read_name(di->d_name, entry->name) < 0)
+			continue;
+
+		strcpy(entry->node, di->d_name);
+		input_index_count++;
+	}
+
+	closedir(d);
+
+	ALOGV("%s: %d input devices", __func__, input_index_count);
+}
+
+/* Called with input_index_mutex held */
+static struct input_index_entry *input_index_find(const char *name, int rescan)
+{
+	int i;
+
+	if (input_index_count < 0 || rescan)
+		input_index_build();
+
+	for (i = 0; i < input_index_count; i++) {
+		if (strcmp(input_index[i].name, name) == 0)
+			return &input_index[i];
+	}
+
+	return NULL;
+}
+
+static int input_index_open_entry(struct input_index_entry *entry,
+	const char *name, int flags)
+{
+	char input_name[INPUT_NAME_MAX] = { 0 };
+	char path[PATH_MAX];
+	int fd;
+
+	snprintf(path, sizeof(path), INPUT_DEV_PATH "%s", entry->node);
+
+	fd = open(path, flags);
+	if (fd < 0)
+		return -errno;
+
+	// the node may have been reused by another device since the scan
+	if (ioctl(fd, EVIOCGNAME(sizeof(input_name) - 1), input_name) < 0 ||
+		strcmp(input_name, name) != 0) {
+		close(fd);
+		return -ENODEV;
+	}
+
+	return fd;
+}
+
+int input_index_open(const char *name, int flags, char *node, size_t node_size)
+{
+	struct input_index_entry *entry;
+	int fresh, rescan;
+	int fd = -ENODEV;
+
+	if (name == NULL)
+		return -EINVAL;
+
+	pthread_mutex_lock(&input_index_mutex);
+
+	// a stale index gets a single rescan
+	fresh = input_index_count < 0;
+	for (rescan = 0; rescan < (fresh ? 1 : 2); rescan++) {
+		entry = input_index_find(name, rescan);
+		if (entry == NULL)
+			continue;
+
+		fd = input_index_open_entry(entry, name, flags);
+		if (fd >= 0) {
+			if (node != NULL)
+				snprintf(node, node_size, "%s", entry->node);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&input_index_mutex);
+
+	if (fd < 0)
+		ALOGE("%s: Unable to find input device %s", __func__, name);
+
+	return fd;
+}
+
+int input_index_sysfs_path(const char *name, char *path, size_t size)
+{
+	struct input_index_entry *entry;
+	int fresh;
+
+	if (name == NULL || path == NULL)
+		return -EINVAL;
+
+	pthread_mutex_lock(&input_index_mutex);
+
+	fresh = input_index_count < 0;
+	entry = input_index_find(name, 0);
+	if (entry == NULL && !fresh)
+		entry = input_index_find(name, 1);
+	if (entry != NULL)
+		snprintf(path, size, INPUT_SYSFS_PATH "%s/device", entry->node);
+
+	pthread_mutex_unlock(&input_index_mutex);
+
+	return entry != NULL ? 0 : -ENODEV;
+}
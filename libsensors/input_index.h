@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_INPUT_INDEX_H
+#define ANDROID_INPUT_INDEX_H
+
+#include <stddef.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/*****************************************************************************/
+
+#ifndef INPUT_SYSFS_PATH
+#define INPUT_SYSFS_PATH "/sys/class/input/"
+#endif
+
+#ifndef INPUT_DEV_PATH
+#define INPUT_DEV_PATH "/dev/input/"
+#endif
+
+/*
+ * Name to event node index of the input devices, built from sysfs
+ * without opening any device. The index is built on first use and
+ * rebuilt when a lookup misses or finds a node that no longer matches
+ * its name: hotplugged devices are picked up by the next lookup of
+ * their name, nothing listens for hotplug events.
+ */
+
+/*
+ * Open the event node of the named input device with the given open(2)
+ * flags. The node name (eventN) is copied to node when not NULL.
+ * Returns the fd or a negative errno.
+ */
+int input_index_open(const char *name, int flags, char *node, size_t node_size);
+
+/*
+ * Copy the sysfs directory holding the attributes of the named input
+ * device, without trailing slash, to path. Returns 0 or a negative errno.
+ */
+int input_index_sysfs_path(const char *name, char *path, size_t size);
+
+/*****************************************************************************/
+
+__END_DECLS
+
+#endif  // ANDROID_INPUT_INDEX_H
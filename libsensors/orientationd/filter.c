@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "orientationd.h"
+
+/*
+ * Gyro-less complementary filter: the attitude measured from the
+ * acceleration and magnetic field is noisy, the quaternion state follows
+ * it through a first order low-pass on the rotation group, turning
+ * towards each measurement by dt / (time constant + dt) of the way.
+ */
+
+/* Longest gap between samples still filtered across, in ns */
+#define FILTER_MAX_GAP		1000000000LL
+
+static void cross(const float a[3], const float b[3], float r[3])
+{
+	r[0] = a[1] * b[2] - a[2] * b[1];
+	r[1] = a[2] * b[0] - a[0] * b[2];
+	r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static int normalize(float v[3])
+{
+	float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+
+	if (length < 1e-6f)
+		return -1;
+
+	v[0] /= length;
+	v[1] /= length;
+	v[2] /= length;
+
+	return 0;
+}
+
+/*
+ * Attitude as a quaternion (x, y, z, w), from the rotation matrix with
+ * east, north and up as rows, like SensorManager.getRotationMatrix()
+ */
+static int filter_attitude(const sensors_vec_t *acceleration,
+	const sensors_vec_t *magnetic, float q[4])
+{
+	float a[3] = { acceleration->x, acceleration->y, acceleration->z };
+	float m[3] = { magnetic->x, magnetic->y, magnetic->z };
+	float h[3], n[3];
+	float trace, s;
+
+	if (normalize(a) < 0)
+		return -1;
+
+	cross(m, a, h);
+	if (normalize(h) < 0)
+		return -1;
+
+	cross(a, h, n);
+
+	/* Shepperd's method, from the largest diagonal term */
+	trace = h[0] + n[1] + a[2];
+	if (trace > 0) {
+		s = sqrtf(trace + 1.0f) * 2.0f;
+		q[3] = 0.25f * s;
+		q[0] = (a[1] - n[2]) / s;
+		q[1] = (h[2] - a[0]) / s;
+		q[2] = (n[0] - h[1]) / s;
+	} else if (h[0] > n[1] && h[0] > a[2]) {
+		s = sqrtf(1.0f + h[0] - n[1] - a[2]) * 2.0f;
+		q[3] = (a[1] - n[2]) / s;
+		q[0] = 0.25f * s;
+		q[1] = (h[1] + n[0]) / s;
+		q[2] = (h[2] + a[0]) / s;
+	} else if (n[1] > a[2]) {
+		s = sqrtf(1.0f + n[1] - h[0] - a[2]) * 2.0f;
+		q[3] = (h[2] - a[0]) / s;
+		q[0] = (h[1] + n[0]) / s;
+		q[1] = 0.25f * s;
+		q[2] = (n[2] + a[1]) / s;
+	} else {
+		s = sqrtf(1.0f + a[2] - h[0] - n[1]) * 2.0f;
+		q[3] = (n[0] - h[1]) / s;
+		q[0] = (h[2] + a[0]) / s;
+		q[1] = (n[2] + a[1]) / s;
+		q[2] = 0.25f * s;
+	}
+
+	return 0;
+}
+
+void filter_reset(struct orientationd_filter *filter)
+{
+	if (filter == NULL)
+		return;
+
+	filter->valid = 0;
+}
+
+int filter_update(struct orientationd_filter *filter,
+	const sensors_vec_t *acceleration, const sensors_vec_t *magnetic,
+	int64_t timestamp)
+{
+	float q[4];
+	float dot, angle, sa, wa, wb, k, dt, length;
+	int i;
+
+	if (filter == NULL || acceleration == NULL || magnetic == NULL)
+		return -EINVAL;
+
+	if (filter_attitude(acceleration, magnetic, q) < 0)
+		return -1;
+
+	if (!filter->valid || timestamp <= filter->timestamp ||
+		timestamp - filter->timestamp > FILTER_MAX_GAP) {
+		memcpy(filter->q, q, sizeof(q));
+		filter->timestamp = timestamp;
+		filter->valid = 1;
+		return 0;
+	}
+
+	dt = (timestamp - filter->timestamp) * 1e-9f;
+	k = dt / (filter->time_constant + dt);
+	filter->timestamp = timestamp;
+
+	/* q and -q are the same attitude, take the short way */
+	dot = filter->q[0] * q[0] + filter->q[1] * q[1] + filter->q[2] * q[2] + filter->q[3] * q[3];
+	if (dot < 0) {
+		dot = -dot;
+		for (i = 0; i < 4; i++)
+			q[i] = -q[i];
+	}
+
+	if (dot > 1.0f)
+		dot = 1.0f;
+
+	angle = acosf(dot);
+	sa = sinf(angle);
+	if (sa < 1e-3f) {
+		wa = 1.0f - k;
+		wb = k;
+	} else {
+		wa = sinf((1.0f - k) * angle) / sa;
+		wb = sinf(k * angle) / sa;
+	}
+
+	length = 0.0f;
+	for (i = 0; i < 4; i++) {
+		filter->q[i] = wa * filter->q[i] + wb * q[i];
+		length += filter->q[i] * filter->q[i];
+	}
+
+	/* keep the state a unit quaternion as rounding errors pile up */
+	length = sqrtf(length);
+	for (i = 0; i < 4; i++)
+		filter->q[i] /= length;
+
+	return 0;
+}
+
+/*
+ * Azimuth, pitch and roll of the filtered attitude, through the vector
+ * kernel
+ */
+void filter_orientation(struct orientationd_filter *filter, sensors_vec_t *o)
+{
+	if (filter == NULL || o == NULL)
+		return;
+
+	orientation_quaternion(filter->q, o);
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#define LOG_TAG "orientationd"
+#include <utils/Log.h>
+
+#include "orientationd.h"
+
+/*
+ * Frames further apart than this are not interpolated between, the
+ * sensor was stopped in between
+ */
+#define HISTORY_MAX_GAP		500000000LL
+
+/*
+ * Past the newest frame, the last two are extrapolated from for at most
+ * this fraction of their interval
+ */
+#define HISTORY_MAX_EXTRAPOLATION	0.25f
+
+void history_reset(struct orientationd_history *history)
+{
+	if (history == NULL)
+		return;
+
+	memset(history, 0, sizeof(struct orientationd_history));
+}
+
+void history_push(struct orientationd_history *history, sensors_vec_t *value,
+	int64_t timestamp)
+{
+	struct orientationd_sample *sample;
+
+	if (history == NULL || value == NULL)
+		return;
+
+	history->head = (history->head + 1) % ORIENTATIOND_HISTORY;
+	if (history->count < ORIENTATIOND_HISTORY)
+		history->count++;
+
+	sample = &history->samples[history->head];
+	sample->value = *value;
+	sample->timestamp = timestamp;
+}
+
+static struct orientationd_sample *history_get(struct orientationd_history *history,
+	int age)
+{
+	return &history->samples[(history->head - age + ORIENTATIOND_HISTORY) % ORIENTATIOND_HISTORY];
+}
+
+int64_t history_newest(struct orientationd_history *history)
+{
+	if (history == NULL || history->count == 0)
+		return 0;
+
+	return history_get(history, 0)->timestamp;
+}
+
+/*
+ * Latest time both histories can be interpolated at: the older of their
+ * newest frames, or the newer one when the other stopped. 0 until both
+ * have a frame.
+ */
+int64_t history_common(struct orientationd_history *a,
+	struct orientationd_history *b)
+{
+	int64_t ta, tb;
+
+	ta = history_newest(a);
+	tb = history_newest(b);
+	if (ta == 0 || tb == 0)
+		return 0;
+
+	if (ta - tb > HISTORY_MAX_GAP || tb - ta > HISTORY_MAX_GAP)
+		return ta > tb ? ta : tb;
+
+	return ta < tb ? ta : tb;
+}
+
+/*
+ * The two frames to interpolate between at timestamp and the position of
+ * timestamp from the first (0) to the second (1). A single frame comes
+ * back as both.
+ */
+static int history_find(struct orientationd_history *history, int64_t timestamp,
+	struct orientationd_sample **a, struct orientationd_sample **b, float *u)
+{
+	struct orientationd_sample *older, *newer;
+	int64_t interval;
+	int i;
+
+	if (history == NULL || history->count == 0)
+		return -EINVAL;
+
+	newer = history_get(history, 0);
+	*a = *b = newer;
+	*u = 0.0f;
+
+	for (i = 1; i < history->count; i++) {
+		older = history_get(history, i);
+		interval = newer->timestamp - older->timestamp;
+
+		if (interval <= 0 || interval > HISTORY_MAX_GAP) {
+			*a = *b = newer;
+			break;
+		}
+
+		if (older->timestamp <= timestamp || i == history->count - 1) {
+			*a = older;
+			*b = newer;
+			*u = (float) (timestamp - older->timestamp) / interval;
+			break;
+		}
+
+		newer = older;
+	}
+
+	if (*u < 0.0f)
+		*u = 0.0f;
+	if (*u > 1.0f + HISTORY_MAX_EXTRAPOLATION)
+		*u = 1.0f + HISTORY_MAX_EXTRAPOLATION;
+
+	return 0;
+}
+
+int history_lerp(struct orientationd_history *history, int64_t timestamp,
+	sensors_vec_t *value)
+{
+	struct orientationd_sample *a, *b;
+	float u;
+	int rc;
+
+	if (value == NULL)
+		return -EINVAL;
+
+	rc = history_find(history, timestamp, &a, &b, &u);
+	if (rc < 0)
+		return rc;
+
+	value->x = a->value.x + u * (b->value.x - a->value.x);
+	value->y = a->value.y + u * (b->value.y - a->value.y);
+	value->z = a->value.z + u * (b->value.z - a->value.z);
+
+	return 0;
+}
+
+/*
+ * Turns the direction at a constant rate between the frames and
+ * interpolates the length linearly, for the magnetic field whose
+ * direction changes while its strength does not.
+ */
+int history_slerp(struct orientationd_history *history, int64_t timestamp,
+	sensors_vec_t *value)
+{
+	struct orientationd_sample *a, *b;
+	float la, lb, dot, angle, sa, wa, wb, length;
+	float u;
+	int rc;
+
+	if (value == NULL)
+		return -EINVAL;
+
+	rc = history_find(history, timestamp, &a, &b, &u);
+	if (rc < 0)
+		return rc;
+
+	la = sqrtf(a->value.x * a->value.x + a->value.y * a->value.y + a->value.z * a->value.z);
+	lb = sqrtf(b->value.x * b->value.x + b->value.y * b->value.y + b->value.z * b->value.z);
+	if (la < 1e-6f || lb < 1e-6f)
+		return history_lerp(history, timestamp, value);
+
+	dot = (a->value.x * b->value.x + a->value.y * b->value.y + a->value.z * b->value.z) / (la * lb);
+	if (dot > 1.0f)
+		dot = 1.0f;
+	if (dot < -1.0f)
+		dot = -1.0f;
+
+	angle = acosf(dot);
+	sa = sinf(angle);
+
+	/* nearly parallel or opposite, the linear weights will do */
+	if (sa < 1e-3f) {
+		wa = 1.0f - u;
+		wb = u;
+	} else {
+		wa = sinf((1.0f - u) * angle) / sa;
+		wb = sinf(u * angle) / sa;
+	}
+
+	length = la + u * (lb - la);
+
+	value->x = (wa * a->value.x / la + wb * b->value.x / lb) * length;
+	value->y = (wa * a->value.y / la + wb * b->value.y / lb) * length;
+	value->z = (wa * a->value.z / la + wb * b->value.z / lb) * length;
+
+	return 0;
+}
@@ -21,7 +21,7 @@
 #include <stdint.h>
 #include <fcntl.h>
 #include <errno.h>
-#include <dirent.h>
+#include <sys/ioctl.h>
 #include <linux/ioctl.h>
 #include <linux/input.h>
 
@@ -30,6 +30,8 @@
 
 #include "orientationd.h"
 
+#define LONG_BITS	(sizeof(unsigned long) * 8)
+
 void input_event_set(struct input_event *event, int type, int code, int value)
 {
 	if (event == NULL)
@@ -44,6 +46,24 @@ void input_event_set(struct input_event *event, int type, int code, int value)
 	gettimeofday(&event->time, NULL);
 }
 
+/*
+ * Reads up to count queued events at once, returns how many were read, 0
+ * if none was queued
+ */
+int input_events_read(int fd, struct input_event *events, int count)
+{
+	int rc;
+
+	if (events == NULL || count <= 0)
+		return -EINVAL;
+
+	rc = read(fd, events, count * sizeof(struct input_event));
+	if (rc < 0)
+		return errno == EAGAIN ? 0 : -1;
+
+	return rc / sizeof(struct input_event);
+}
+
 int64_t timestamp(struct timeval *time)
 {
 	if (time == NULL)
@@ -52,46 +72,27 @@ int64_t timestamp(struct timeval *time)
 	return (int64_t) (time->tv_sec * 1000000000LL + time->tv_usec * 1000);
 }
 
-int input_open(char *name)
+/*
+ * Whether the input device declares all the count ABS codes, the input
+ * core drops the events of the ones it does not
+ */
+int input_abs_declared(int fd, const int *codes, int count)
 {
-	DIR *d;
-	struct dirent *di;
-
-	char input_name[80] = { 0 };
-	char path[PATH_MAX];
-	char *c;
-	int fd;
-	int rc;
+	unsigned long bits[ABS_MAX / LONG_BITS + 1];
+	int i;
 
-	if (name == NULL)
+	if (codes == NULL || count <= 0)
 		return -EINVAL;
 
-	d = opendir("/dev/input");
-	if (d == NULL)
-		return -1;
-
-	while ((di = readdir(d))) {
-		if (di == NULL || strcmp(di->d_name, ".") == 0 || strcmp(di->d_name, "..") == 0)
-			continue;
-
-		snprintf(path, PATH_MAX, "/dev/input/%s", di->d_name);
-		fd = open(path, O_RDWR | O_NONBLOCK);
-		if (fd < 0)
-			continue;
+	memset(bits, 0, sizeof(bits));
 
-		rc = ioctl(fd, EVIOCGNAME(sizeof(input_name) - 1), &input_name);
-		if (rc < 0)
-			continue;
-
-		c = strstr((char *) &input_name, "\n");
-		if (c != NULL)
-			*c = '\0';
+	if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(bits)), bits) < 0)
+		return -1;
 
-		if (strcmp(input_name, name) == 0)
-			return fd;
-		else
-			close(fd);
-	}
+	for (i = 0; i < count; i++)
+		if (codes[i] < 0 || codes[i] > ABS_MAX ||
+			!(bits[codes[i] / LONG_BITS] & (1UL << (codes[i] % LONG_BITS))))
+			return 0;
 
-	return -1;
+	return 1;
 }
@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "orientationd.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ORIENTATION_NEON
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define ORIENTATION_SSE
+#endif
+
+/*
+ * The batch kernel works on 4 samples at once with the GCC vector
+ * extensions, which map to NEON on the target and SSE on the host. Only
+ * the reciprocal and reciprocal square root estimates need the
+ * instruction set itself.
+ */
+typedef float v4f __attribute__((vector_size(16)));
+typedef int32_t v4i __attribute__((vector_size(16)));
+
+#define RAD2DEG		(180.0f / 3.1415926535f)
+#define PI		3.1415926535f
+#define PI_2		1.5707963268f
+
+static float rad2deg(float v)
+{
+	return (v * 180.0f / 3.1415926535f);
+}
+
+static float vector_scalar(const sensors_vec_t *v, const sensors_vec_t *d)
+{
+	return v->x * d->x + v->y * d->y + v->z * d->z;
+}
+
+static float vector_length(const sensors_vec_t *v)
+{
+	return sqrtf(vector_scalar(v, v));
+}
+
+/*
+ * Reference implementation, with libm
+ */
+void orientation_compute(const sensors_vec_t *a, const sensors_vec_t *m,
+	sensors_vec_t *o)
+{
+	float azimuth, pitch, roll;
+	float la, sinp, cosp, sinr, cosr, x, y;
+
+	la = vector_length(a);
+	pitch = asinf(-(a->y) / la);
+	roll = asinf((a->x) / la);
+
+	sinp = sinf(pitch);
+	cosp = cosf(pitch);
+	sinr = sinf(roll);
+	cosr = cosf(roll);
+
+	y = -(m->x) * cosr + m->z * sinr;
+	x = m->x * sinp * sinr + m->y * cosp + m->z * sinp * cosr;
+	azimuth = atan2f(y, x);
+
+	o->azimuth = rad2deg(azimuth);
+	o->pitch = rad2deg(pitch);
+	o->roll = rad2deg(roll);
+
+	if (o->azimuth < 0)
+		o->azimuth += 360.0f;
+}
+
+static inline v4f v4_splat(float v)
+{
+	v4f r = { v, v, v, v };
+	return r;
+}
+
+static inline v4f v4_select(v4i mask, v4f a, v4f b)
+{
+	return (v4f) (((v4i) a & mask) | ((v4i) b & ~mask));
+}
+
+static inline v4f v4_abs(v4f v)
+{
+	return (v4f) ((v4i) v & ~(v4i) v4_splat(-0.0f));
+}
+
+/* 1 / sqrt(v), to about 22 bits */
+static inline v4f v4_rsqrt(v4f v)
+{
+#if defined(ORIENTATION_NEON)
+	float32x4_t x = (float32x4_t) v;
+	float32x4_t e = vrsqrteq_f32(x);
+	e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(x, e), e));
+	e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(x, e), e));
+	return (v4f) e;
+#elif defined(ORIENTATION_SSE)
+	v4f e = (v4f) _mm_rsqrt_ps((__m128) v);
+	return e * (v4_splat(1.5f) - v4_splat(0.5f) * v * e * e);
+#else
+	v4f r;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		r[i] = 1.0f / sqrtf(v[i]);
+	return r;
+#endif
+}
+
+/* 1 / v, to about 22 bits */
+static inline v4f v4_rcp(v4f v)
+{
+#if defined(ORIENTATION_NEON)
+	float32x4_t x = (float32x4_t) v;
+	float32x4_t e = vrecpeq_f32(x);
+	e = vmulq_f32(e, vrecpsq_f32(x, e));
+	e = vmulq_f32(e, vrecpsq_f32(x, e));
+	return (v4f) e;
+#elif defined(ORIENTATION_SSE)
+	v4f e = (v4f) _mm_rcp_ps((__m128) v);
+	return e * (v4_splat(2.0f) - v * e);
+#else
+	return v4_splat(1.0f) / v;
+#endif
+}
+
+/*
+ * atan2 from a degree 9 minimax polynomial of atan on [0, 1], within
+ * 0.0007 degree
+ */
+static inline v4f v4_atan2(v4f y, v4f x)
+{
+	v4f ay = v4_abs(y);
+	v4f ax = v4_abs(x);
+	v4i steep = ay > ax;
+	v4f num = v4_select(steep, ax, ay);
+	v4f den = v4_select(steep, ay, ax);
+	v4f t, t2, p;
+
+	/* both 0 comes out as 0, like atan2f */
+	den = v4_select(den > v4_splat(1e-30f), den, v4_splat(1.0f));
+	t = num * v4_rcp(den);
+	t2 = t * t;
+
+	p = v4_splat(0.0208351f);
+	p = p * t2 + v4_splat(-0.0851330f);
+	p = p * t2 + v4_splat(0.1801410f);
+	p = p * t2 + v4_splat(-0.3302995f);
+	p = p * t2 + v4_splat(0.9998660f);
+	p = p * t;
+
+	p = v4_select(steep, v4_splat(PI_2) - p, p);
+	p = v4_select(x < v4_splat(0.0f), v4_splat(PI) - p, p);
+
+	/* sign of y */
+	return (v4f) ((v4i) p | ((v4i) y & (v4i) v4_splat(-0.0f)));
+}
+
+/* sqrt(v) for v >= 0 */
+static inline v4f v4_sqrt(v4f v)
+{
+	v4f r = v * v4_rsqrt(v4_select(v > v4_splat(1e-30f), v, v4_splat(1.0f)));
+	return v4_select(v > v4_splat(1e-30f), r, v4_splat(0.0f));
+}
+
+/*
+ * Same as orientation_compute, without the trigonometry: the sines of the
+ * pitch and roll are the normalized acceleration, their cosines follow
+ * from the sines since both angles are within [-90, 90], and the three
+ * angles come from atan2.
+ */
+static void orientation_compute4(v4f ax, v4f ay, v4f az, v4f mx, v4f my,
+	v4f mz, v4f *azimuth, v4f *pitch, v4f *roll)
+{
+	v4f one = v4_splat(1.0f);
+	v4f inv, sinp, cosp, sinr, cosr, x, y, a;
+
+	inv = v4_rsqrt(ax * ax + ay * ay + az * az);
+	sinp = -ay * inv;
+	sinr = ax * inv;
+
+	sinp = v4_select(sinp > one, one, v4_select(sinp < -one, -one, sinp));
+	sinr = v4_select(sinr > one, one, v4_select(sinr < -one, -one, sinr));
+	cosp = v4_sqrt(one - sinp * sinp);
+	cosr = v4_sqrt(one - sinr * sinr);
+
+	y = -mx * cosr + mz * sinr;
+	x = mx * sinp * sinr + my * cosp + mz * sinp * cosr;
+
+	a = v4_atan2(y, x) * v4_splat(RAD2DEG);
+	*azimuth = v4_select(a < v4_splat(0.0f), a + v4_splat(360.0f), a);
+	*pitch = v4_atan2(sinp, cosp) * v4_splat(RAD2DEG);
+	*roll = v4_atan2(sinr, cosr) * v4_splat(RAD2DEG);
+}
+
+/*
+ * Azimuth, pitch and roll of a single sample, from atan2 of the lanes 0,
+ * 1 and 2 at once
+ */
+static void orientation_store(v4f y, v4f x, sensors_vec_t *o)
+{
+	v4f a = v4_atan2(y, x) * v4_splat(RAD2DEG);
+
+	o->azimuth = a[0] < 0 ? a[0] + 360.0f : a[0];
+	o->pitch = a[1];
+	o->roll = a[2];
+}
+
+static float clamp1(float v)
+{
+	return v > 1.0f ? 1.0f : v < -1.0f ? -1.0f : v;
+}
+
+/*
+ * orientation_compute4 for a single sample, with the scalar steps and
+ * the three angles sharing vectors instead of filling 4 lanes each
+ */
+static void orientation_compute1(const sensors_vec_t *a, const sensors_vec_t *m,
+	sensors_vec_t *o)
+{
+	float inv, sinp, cosp, sinr, cosr;
+	v4f s, c, y, x;
+
+	inv = v4_rsqrt(v4_splat(a->x * a->x + a->y * a->y + a->z * a->z))[0];
+	sinp = clamp1(-a->y * inv);
+	sinr = clamp1(a->x * inv);
+
+	s = (v4f) { sinp, sinr, 0.0f, 0.0f };
+	c = v4_sqrt(v4_splat(1.0f) - s * s);
+	cosp = c[0];
+	cosr = c[1];
+
+	y = (v4f) { -m->x * cosr + m->z * sinr, sinp, sinr, 0.0f };
+	x = (v4f) { m->x * sinp * sinr + m->y * cosp + m->z * sinp * cosr,
+		cosp, cosr, 1.0f };
+
+	orientation_store(y, x, o);
+}
+
+/*
+ * Orientation of count acceleration and magnetic field pairs, within 0.01
+ * degree of orientation_compute
+ */
+void orientation_compute_batch(const sensors_vec_t *a, const sensors_vec_t *m,
+	sensors_vec_t *o, int count)
+{
+	v4f ax, ay, az, mx, my, mz;
+	v4f azimuth, pitch, roll;
+	int i, j, k, n;
+
+	if (a == NULL || m == NULL || o == NULL)
+		return;
+
+	for (i = 0; i < count; i += 4) {
+		n = count - i < 4 ? count - i : 4;
+
+		/* a lone sample, as orientationd computes them */
+		if (n == 1) {
+			orientation_compute1(&a[i], &m[i], &o[i]);
+			break;
+		}
+
+		/* the lanes past the end repeat the last sample */
+		for (j = 0; j < 4; j++) {
+			k = i + (j < n ? j : n - 1);
+			ax[j] = a[k].x;
+			ay[j] = a[k].y;
+			az[j] = a[k].z;
+			mx[j] = m[k].x;
+			my[j] = m[k].y;
+			mz[j] = m[k].z;
+		}
+
+		orientation_compute4(ax, ay, az, mx, my, mz, &azimuth, &pitch, &roll);
+
+		for (j = 0; j < n; j++) {
+			o[i + j].azimuth = azimuth[j];
+			o[i + j].pitch = pitch[j];
+			o[i + j].roll = roll[j];
+		}
+	}
+}
+
+/*
+ * Azimuth, pitch and roll of an attitude quaternion (x, y, z, w), with
+ * east, north and up as the rows of its rotation matrix. Pitch and roll
+ * are the tilt of the up vector, as orientation_compute, the azimuth is
+ * the heading of the device y axis, as SensorManager.getOrientation().
+ */
+void orientation_quaternion(const float q[4], sensors_vec_t *o)
+{
+	float r1, r4, r6, r7;
+	v4f s, c, y, x;
+
+	if (q == NULL || o == NULL)
+		return;
+
+	r1 = 2.0f * (q[0] * q[1] - q[2] * q[3]);
+	r4 = 1.0f - 2.0f * (q[0] * q[0] + q[2] * q[2]);
+	r6 = clamp1(2.0f * (q[0] * q[2] - q[1] * q[3]));
+	r7 = clamp1(2.0f * (q[1] * q[2] + q[0] * q[3]));
+
+	/* the pitch and roll are asin(-r7) and asin(r6) */
+	s = (v4f) { r7, r6, 0.0f, 0.0f };
+	c = v4_sqrt(v4_splat(1.0f) - s * s);
+
+	y = (v4f) { r1, -r7, r6, 0.0f };
+	x = (v4f) { r4, c[0], c[1], 1.0f };
+
+	orientation_store(y, x, o);
+}
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Speed and accuracy of the orientation computations of orientationd.
+ *
+ *   orientationbench [samples] [rounds]
+ *
+ * Runs orientation_compute (libm) and orientation_compute_batch, over
+ * all samples at once and one sample per call as orientationd does, on
+ * random accelerometer and magnetometer pairs. Then the conversion of the
+ * filter's quaternions to angles, with libm and orientation_quaternion.
+ * Prints the time per sample of each and their largest error against a
+ * double precision computation, per angle.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "orientationd.h"
+
+#define BENCH_SAMPLES	4096
+#define BENCH_ROUNDS	200
+
+struct bench_error {
+	double azimuth;
+	double pitch;
+	double roll;
+};
+
+static int64_t now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t) t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static void random_vector(sensors_vec_t *v, float length)
+{
+	float x, y, z, l;
+
+	do {
+		x = (float) (drand48() * 2.0 - 1.0);
+		y = (float) (drand48() * 2.0 - 1.0);
+		z = (float) (drand48() * 2.0 - 1.0);
+		l = sqrtf(x * x + y * y + z * z);
+	} while (l > 1.0f || l < 0.01f);
+
+	v->x = x / l * length;
+	v->y = y / l * length;
+	v->z = z / l * length;
+}
+
+static void reference(const sensors_vec_t *a, const sensors_vec_t *m,
+	double *azimuth, double *pitch, double *roll)
+{
+	double la, sinp, cosp, sinr, cosr, x, y;
+
+	la = sqrt((double) a->x * a->x + (double) a->y * a->y + (double) a->z * a->z);
+	sinp = fmax(-1.0, fmin(1.0, -a->y / la));
+	sinr = fmax(-1.0, fmin(1.0, a->x / la));
+	cosp = sqrt(1.0 - sinp * sinp);
+	cosr = sqrt(1.0 - sinr * sinr);
+
+	y = -m->x * cosr + m->z * sinr;
+	x = m->x * sinp * sinr + m->y * cosp + m->z * sinp * cosr;
+
+	*azimuth = atan2(y, x) * 180.0 / M_PI;
+	if (*azimuth < 0)
+		*azimuth += 360.0;
+	*pitch = asin(sinp) * 180.0 / M_PI;
+	*roll = asin(sinr) * 180.0 / M_PI;
+}
+
+static void random_quaternion(float q[4])
+{
+	double x, y, z, w, l;
+
+	do {
+		x = drand48() * 2.0 - 1.0;
+		y = drand48() * 2.0 - 1.0;
+		z = drand48() * 2.0 - 1.0;
+		w = drand48() * 2.0 - 1.0;
+		l = sqrt(x * x + y * y + z * z + w * w);
+	} while (l > 1.0 || l < 0.01);
+
+	q[0] = x / l;
+	q[1] = y / l;
+	q[2] = z / l;
+	q[3] = w / l;
+}
+
+static void quaternion_reference(const float q[4], double *azimuth,
+	double *pitch, double *roll)
+{
+	double r1, r4, r6, r7;
+
+	r1 = 2.0 * ((double) q[0] * q[1] - (double) q[2] * q[3]);
+	r4 = 1.0 - 2.0 * ((double) q[0] * q[0] + (double) q[2] * q[2]);
+	r6 = fmax(-1.0, fmin(1.0, 2.0 * ((double) q[0] * q[2] - (double) q[1] * q[3])));
+	r7 = fmax(-1.0, fmin(1.0, 2.0 * ((double) q[1] * q[2] + (double) q[0] * q[3])));
+
+	*azimuth = atan2(r1, r4) * 180.0 / M_PI;
+	if (*azimuth < 0)
+		*azimuth += 360.0;
+	*pitch = asin(-r7) * 180.0 / M_PI;
+	*roll = asin(r6) * 180.0 / M_PI;
+}
+
+/* the conversion of the filter with libm */
+static void quaternion_libm(const float q[4], sensors_vec_t *o)
+{
+	float r1, r4, r6, r7;
+
+	r1 = 2.0f * (q[0] * q[1] - q[2] * q[3]);
+	r4 = 1.0f - 2.0f * (q[0] * q[0] + q[2] * q[2]);
+	r6 = fmaxf(-1.0f, fminf(1.0f, 2.0f * (q[0] * q[2] - q[1] * q[3])));
+	r7 = fmaxf(-1.0f, fminf(1.0f, 2.0f * (q[1] * q[2] + q[0] * q[3])));
+
+	o->azimuth = atan2f(r1, r4) * 180.0f / 3.1415926535f;
+	if (o->azimuth < 0)
+		o->azimuth += 360.0f;
+	o->pitch = asinf(-r7) * 180.0f / 3.1415926535f;
+	o->roll = asinf(r6) * 180.0f / 3.1415926535f;
+}
+
+static double angle_error(double a, double b)
+{
+	double d = fabs(a - b);
+
+	return d > 180.0 ? 360.0 - d : d;
+}
+
+static void measure(const sensors_vec_t *a, const sensors_vec_t *m,
+	const sensors_vec_t *o, int count, struct bench_error *error)
+{
+	double azimuth, pitch, roll;
+	int i;
+
+	memset(error, 0, sizeof(struct bench_error));
+
+	for (i = 0; i < count; i++) {
+		reference(&a[i], &m[i], &azimuth, &pitch, &roll);
+
+		error->azimuth = fmax(error->azimuth, angle_error(o[i].azimuth, azimuth));
+		error->pitch = fmax(error->pitch, angle_error(o[i].pitch, pitch));
+		error->roll = fmax(error->roll, angle_error(o[i].roll, roll));
+	}
+}
+
+static void measure_quaternions(float (*q)[4], const sensors_vec_t *o,
+	int count, struct bench_error *error)
+{
+	double azimuth, pitch, roll;
+	int i;
+
+	memset(error, 0, sizeof(struct bench_error));
+
+	for (i = 0; i < count; i++) {
+		quaternion_reference(q[i], &azimuth, &pitch, &roll);
+
+		error->azimuth = fmax(error->azimuth, angle_error(o[i].azimuth, azimuth));
+		error->pitch = fmax(error->pitch, angle_error(o[i].pitch, pitch));
+		error->roll = fmax(error->roll, angle_error(o[i].roll, roll));
+	}
+}
+
+static void print(const char *name, int64_t ns, int count, struct bench_error *error)
+{
+	printf("%-8s %8.1f ns/sample %8.2f Msamples/s   max error azimuth %.4f pitch %.4f roll %.4f deg\n",
+		name, (double) ns / count, count * 1e3 / ns,
+		error->azimuth, error->pitch, error->roll);
+}
+
+int main(int argc, char *argv[])
+{
+	sensors_vec_t *a, *m, *o;
+	float (*q)[4];
+	struct bench_error error;
+	int64_t start, libm_ns, batch_ns, single_ns;
+	int samples = BENCH_SAMPLES;
+	int rounds = BENCH_ROUNDS;
+	int i, r;
+
+	if (argc > 1)
+		samples = atoi(argv[1]);
+	if (argc > 2)
+		rounds = atoi(argv[2]);
+	if (samples <= 0 || rounds <= 0) {
+		fprintf(stderr, "usage: %s [samples] [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	a = (sensors_vec_t *) calloc(samples, sizeof(sensors_vec_t));
+	m = (sensors_vec_t *) calloc(samples, sizeof(sensors_vec_t));
+	o = (sensors_vec_t *) calloc(samples, sizeof(sensors_vec_t));
+	q = (float (*)[4]) calloc(samples, sizeof(float[4]));
+	if (a == NULL || m == NULL || o == NULL || q == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	/* the device in any attitude, in a field of the earth's strength */
+	srand48(1);
+	for (i = 0; i < samples; i++) {
+		random_vector(&a[i], GRAVITY_EARTH);
+		random_vector(&m[i], 45.0f);
+		random_quaternion(q[i]);
+	}
+
+	start = now();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < samples; i++)
+			orientation_compute(&a[i], &m[i], &o[i]);
+	libm_ns = now() - start;
+
+	measure(a, m, o, samples, &error);
+	print("libm", libm_ns, samples * rounds, &error);
+
+	start = now();
+	for (r = 0; r < rounds; r++)
+		orientation_compute_batch(a, m, o, samples);
+	batch_ns = now() - start;
+
+	measure(a, m, o, samples, &error);
+	print("batch", batch_ns, samples * rounds, &error);
+
+	start = now();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < samples; i++)
+			orientation_compute_batch(&a[i], &m[i], &o[i], 1);
+	single_ns = now() - start;
+
+	measure(a, m, o, samples, &error);
+	print("single", single_ns, samples * rounds, &error);
+
+	printf("speedup  %.2fx batch, %.2fx single\n", (double) libm_ns / batch_ns,
+		(double) libm_ns / single_ns);
+
+	start = now();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < samples; i++)
+			quaternion_libm(q[i], &o[i]);
+	libm_ns = now() - start;
+
+	measure_quaternions(q, o, samples, &error);
+	print("q libm", libm_ns, samples * rounds, &error);
+
+	start = now();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < samples; i++)
+			orientation_quaternion(q[i], &o[i]);
+	single_ns = now() - start;
+
+	measure_quaternions(q, o, samples, &error);
+	print("q vector", single_ns, samples * rounds, &error);
+
+	printf("speedup  %.2fx quaternion\n", (double) libm_ns / single_ns);
+
+	free(a);
+	free(m);
+	free(o);
+	free(q);
+
+	return 0;
+}
@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <poll.h>
 #include <math.h>
+#include <sys/timerfd.h>
 #include <linux/input.h>
 
 #include <hardware/sensors.h>
@@ -29,8 +30,10 @@
 
 #define LOG_TAG "orientationd"
 #include <utils/Log.h>
+#include <cutils/properties.h>
 
 #include "orientationd.h"
+#include "input_index.h"
 
 struct orientationd_handlers *orientationd_handlers[] = {
 	&bma250,
@@ -40,119 +43,170 @@ struct orientationd_handlers *orientationd_handlers[] = {
 int orientationd_handlers_count = sizeof(orientationd_handlers) /
 	sizeof(struct orientationd_handlers *);
 
-static float rad2deg(float v)
+int orientation_calculate(struct orientationd_data *data)
 {
-	return (v * 180.0f / 3.1415926535f);
-}
+	if (data == NULL)
+		return -EINVAL;
 
-static float vector_scalar(sensors_vec_t *v, sensors_vec_t *d)
-{
-	return v->x * d->x + v->y * d->y + v->z * d->z;
+	orientation_compute_batch(&data->acceleration, &data->magnetic,
+		&data->orientation, 1);
+
+	return 0;
 }
 
-static float vector_length(sensors_vec_t *v)
+int orientation_filter(struct orientationd_data *data, int64_t time)
 {
-	return sqrtf(vector_scalar(v, v));
+	int rc;
+
+	if (data == NULL)
+		return -EINVAL;
+
+	rc = filter_update(&data->filter, &data->acceleration, &data->magnetic, time);
+	if (rc < 0)
+		return rc;
+
+	filter_orientation(&data->filter, &data->orientation);
+
+	return 0;
 }
 
-int orientation_calculate(struct orientationd_data *data)
+int orientation_report(struct orientationd_data *data)
 {
-	sensors_vec_t *a, *m, *o;
-	float azimuth, pitch, roll;
-	float la, sinp, cosp, sinr, cosr, x, y;
+	struct input_event events[8];
+	struct itimerspec timer;
+	int64_t time;
+	int input_fd;
+	int count;
+	int rc;
 
 	if (data == NULL)
 		return -EINVAL;
 
-	a = &data->acceleration;
-	m = &data->magnetic;
-	o = &data->orientation;
+	input_fd = data->input_fd;
+	if (input_fd < 0)
+		return -1;
+
+	data->fresh = 0;
+
+	/*
+	 * Both sensors as of the latest time both have frames for: the
+	 * faster one is interpolated to the slower one, which is not
+	 * extrapolated from. Nothing changed until that time moves on.
+	 */
+	time = history_common(&data->acceleration_history, &data->magnetic_history);
+	if (time <= data->timestamp)
+		return 0;
+
+	data->timestamp = time;
+
+	history_lerp(&data->acceleration_history, time, &data->acceleration);
+	history_slerp(&data->magnetic_history, time, &data->magnetic);
+
+	if (data->filter.time_constant > 0)
+		rc = orientation_filter(data, time);
+	else
+		rc = orientation_calculate(data);
+
+	if (rc < 0) {
+		ALOGE("%s: Unable to calculate orientation", __func__);
+		return -1;
+	}
 
-	la = vector_length(a);
-	pitch = asinf(-(a->y) / la);
-	roll = asinf((a->x) / la);
+	/* the whole frame in one write */
+	count = 0;
+	input_event_set(&events[count++], EV_ABS, ABS_X, (int) (data->orientation.azimuth * 1000));
+	input_event_set(&events[count++], EV_ABS, ABS_Y, (int) (data->orientation.pitch * 1000));
+	input_event_set(&events[count++], EV_ABS, ABS_Z, (int) (data->orientation.roll * 1000));
+
+	if (data->filter.time_constant > 0 && data->quaternion) {
+		input_event_set(&events[count++], EV_ABS, ORIENTATIOND_ABS_QUATERNION_X,
+			(int) (data->filter.q[0] * ORIENTATIOND_QUATERNION_SCALE));
+		input_event_set(&events[count++], EV_ABS, ORIENTATIOND_ABS_QUATERNION_Y,
+			(int) (data->filter.q[1] * ORIENTATIOND_QUATERNION_SCALE));
+		input_event_set(&events[count++], EV_ABS, ORIENTATIOND_ABS_QUATERNION_Z,
+			(int) (data->filter.q[2] * ORIENTATIOND_QUATERNION_SCALE));
+		input_event_set(&events[count++], EV_ABS, ORIENTATIOND_ABS_QUATERNION_W,
+			(int) (data->filter.q[3] * ORIENTATIOND_QUATERNION_SCALE));
+	}
 
-	sinp = sinf(pitch);
-	cosp = cosf(pitch);
-	sinr = sinf(roll);
-	cosr = cosf(roll);
+	input_event_set(&events[count++], EV_SYN, 0, 0);
 
-	y = -(m->x) * cosr + m->z * sinr;
-	x = m->x * sinp * sinr + m->y * cosp + m->z * sinp * cosr;
-	azimuth = atan2f(y, x);
+	rc = write(input_fd, events, count * sizeof(struct input_event));
+	if (rc < (int) (count * sizeof(struct input_event)))
+		ALOGE("%s: Unable to write orientation", __func__);
 
-	o->azimuth = rad2deg(azimuth);
-	o->pitch = rad2deg(pitch);
-	o->roll = rad2deg(roll);
+	/* hold the next sample back until the delay is over */
+	if (data->delay <= 0)
+		return 0;
 
-	if (o->azimuth < 0)
-		o->azimuth += 360.0f;
+	memset(&timer, 0, sizeof(timer));
+	timer.it_value.tv_sec = data->delay / 1000;
+	timer.it_value.tv_nsec = (data->delay % 1000) * 1000000;
+
+	rc = timerfd_settime(data->timer_fd, 0, &timer, NULL);
+	if (rc < 0) {
+		ALOGE("%s: Unable to arm timer", __func__);
+		return -1;
+	}
+
+	data->waiting = 1;
 
 	return 0;
 }
 
-void *orientationd_thread(void *thread_data)
+int orientation_timer(struct orientationd_data *data)
 {
-	struct orientationd_data *data;
-	struct input_event event;
-	struct timeval time;
-	int64_t before, after;
-	useconds_t diff;
-	int input_fd;
+	uint64_t expirations;
 	int rc;
 
-	if (thread_data == NULL)
-		return NULL;
-
-	data = (struct orientationd_data *) thread_data;
+	if (data == NULL)
+		return -EINVAL;
 
-	input_fd = data->input_fd;
-	if (input_fd < 0)
-		return NULL;
+	rc = read(data->timer_fd, &expirations, sizeof(expirations));
+	if (rc < (int) sizeof(expirations))
+		return -1;
 
-	while (data->thread_continue) {
-		pthread_mutex_lock(&data->mutex);
-		if (!data->thread_continue)
-			break;
+	data->waiting = 0;
 
-		while (data->activated) {
-			gettimeofday(&time, NULL);
-			before = timestamp(&time);
+	return 0;
+}
 
-			rc = orientation_calculate(data);
-			if (rc < 0) {
-				ALOGE("%s: Unable to calculate orientation", __func__);
-				goto next;
-			}
+/*
+ * Start over on activation: what the sensors queued while orientationd
+ * was not reading them is stale, the first sample comes from the next
+ * frame.
+ */
+void orientation_start(struct orientationd_data *data)
+{
+	struct itimerspec timer;
+	int i;
 
-			input_event_set(&event, EV_ABS, ABS_X, (int) (data->orientation.azimuth * 1000));
-			write(input_fd, &event, sizeof(event));
-			input_event_set(&event, EV_ABS, ABS_Y, (int) (data->orientation.pitch * 1000));
-			write(input_fd, &event, sizeof(event));
-			input_event_set(&event, EV_ABS, ABS_Z, (int) (data->orientation.roll * 1000));
-			write(input_fd, &event, sizeof(event));
-			input_event_set(&event, EV_SYN, 0, 0);
-			write(input_fd, &event, sizeof(event));
-
-next:
-			gettimeofday(&time, NULL);
-			after = timestamp(&time);
-
-			diff = (useconds_t) (data->delay * 1000000 - (after - before)) / 1000;
-			if (diff <= 0)
-				continue;
+	for (i = 0; i < data->handlers_count; i++) {
+		if (data->handlers[i] == NULL || data->handlers[i]->poll_fd < 0 || data->handlers[i]->get_data == NULL)
+			continue;
 
-			usleep(diff);
-		}
+		while (data->handlers[i]->get_data(data->handlers[i], data) > 0);
 	}
-	return NULL;
+
+	history_reset(&data->acceleration_history);
+	history_reset(&data->magnetic_history);
+	data->timestamp = 0;
+	filter_reset(&data->filter);
+
+	memset(&timer, 0, sizeof(timer));
+	timerfd_settime(data->timer_fd, 0, &timer, NULL);
+
+	data->fresh = 0;
+	data->waiting = 0;
 }
 
 int orientation_get_data(struct orientationd_data *data)
 {
-	struct input_event input_event;
+	struct input_event input_events[ORIENTATIOND_EVENTS_MAX];
+	int activated;
 	int input_fd;
-	int rc;
+	int count;
+	int i;
 
 	if (data == NULL)
 		return -EINVAL;
@@ -161,28 +215,31 @@ int orientation_get_data(struct orientationd_data *data)
 	if (input_fd < 0)
 		return -1;
 
-	do {
-		rc = read(input_fd, &input_event, sizeof(input_event));
-		if (rc < (int) sizeof(input_event))
-			break;
+	count = input_events_read(input_fd, input_events, ORIENTATIOND_EVENTS_MAX);
+	if (count < 0)
+		return -1;
 
-		if (input_event.type == EV_ABS) {
-			switch (input_event.code) {
-				case ABS_THROTTLE:
-					data->activated = input_event.value & (1 << 16) ? 1 : 0;
-					data->delay = input_event.value & ~(1 << 16);
+	for (i = 0; i < count; i++) {
+		if (input_events[i].type != EV_ABS || input_events[i].code != ABS_THROTTLE)
+			continue;
 
-					pthread_mutex_unlock(&data->mutex);
-					break;
-				default:
-					continue;
-			}
-		}
-	} while (input_event.type != EV_SYN);
+		activated = input_events[i].value & (1 << 16) ? 1 : 0;
+		data->delay = input_events[i].value & ~(1 << 16);
+
+		if (activated && !data->activated)
+			orientation_start(data);
+		data->activated = activated;
+	}
 
 	return 0;
 }
 
+/*
+ * Single event loop: the control events of the orientation input device,
+ * the timer and, while activated, the sensor frames. A sample is computed
+ * once the frames of a poll round are read, if any arrived and the timer
+ * is not running.
+ */
 int orientationd_poll(struct orientationd_data *data)
 {
 	int count;
@@ -195,13 +252,17 @@ int orientationd_poll(struct orientationd_data *data)
 	ALOGD("Starting orientationd poll");
 
 	while (1) {
+		/* the orientation input and timer come first */
 		if (data->activated)
 			count = data->poll_fds_count;
 		else
-			count = 1;
+			count = 2;
 
 		rc = poll(data->poll_fds, count, -1);
 		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
 			ALOGE("%s: poll failure", __func__);
 			goto error;
 		}
@@ -215,11 +276,20 @@ int orientationd_poll(struct orientationd_data *data)
 					continue;
 				}
 
+				if (data->poll_fds[i].fd == data->timer_fd) {
+					orientation_timer(data);
+					continue;
+				}
+
 				for (j = 0; j < data->handlers_count; j++)
 					if (data->handlers[j] != NULL && data->handlers[j]->poll_fd == data->poll_fds[i].fd && data->handlers[j]->get_data != NULL)
-						data->handlers[j]->get_data(data->handlers[j], data);
+						if (data->handlers[j]->get_data(data->handlers[j], data) > 0)
+							data->fresh = 1;
 			}
 		}
+
+		if (data->activated && data->fresh && !data->waiting)
+			orientation_report(data);
 	}
 
 	rc = 0;
@@ -234,9 +304,16 @@ complete:
 
 int main(int argc __unused, char *argv[] __unused)
 {
+	static const int quaternion_codes[] = {
+		ORIENTATIOND_ABS_QUATERNION_X,
+		ORIENTATIOND_ABS_QUATERNION_Y,
+		ORIENTATIOND_ABS_QUATERNION_Z,
+		ORIENTATIOND_ABS_QUATERNION_W,
+	};
 	struct orientationd_data *orientationd_data = NULL;
-	pthread_attr_t thread_attr;
+	char value[PROPERTY_VALUE_MAX];
 	int input_fd = -1;
+	int timer_fd = -1;
 	int poll_fd;
 	int p, i;
 	int rc;
@@ -246,12 +323,16 @@ int main(int argc __unused, char *argv[] __unused)
 	orientationd_data->handlers = orientationd_handlers;
 	orientationd_data->handlers_count = orientationd_handlers_count;
 	orientationd_data->activated = 0;
+
+	property_get(ORIENTATIOND_FILTER_PROPERTY, value, ORIENTATIOND_FILTER_DEFAULT);
+	orientationd_data->filter.time_constant = atoi(value) / 1000.0f;
+	ALOGD("Filter time constant: %s ms", value);
 	orientationd_data->poll_fds = (struct pollfd *)
-		calloc(1, (orientationd_handlers_count + 1) * sizeof(struct pollfd));
+		calloc(1, (orientationd_handlers_count + 2) * sizeof(struct pollfd));
 
 	p = 0;
 
-	input_fd = input_open("orientation");
+	input_fd = input_index_open("orientation", O_RDWR | O_NONBLOCK, NULL, 0);
 	if (input_fd < 0) {
 		ALOGE("%s: Unable to open input", __func__);
 		goto error;
@@ -259,15 +340,34 @@ int main(int argc __unused, char *argv[] __unused)
 
 	orientationd_data->input_fd = input_fd;
 
+	rc = input_abs_declared(input_fd, quaternion_codes,
+		sizeof(quaternion_codes) / sizeof(int));
+	orientationd_data->quaternion = rc > 0;
+	ALOGD("Quaternion output: %s", rc > 0 ? "enabled" :
+		rc == 0 ? "codes not declared by the input device" : "unable to check the input device");
+
 	orientationd_data->poll_fds[p].fd = input_fd;
 	orientationd_data->poll_fds[p].events = POLLIN;
 	p++;
 
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer_fd < 0) {
+		ALOGE("%s: Unable to create timer", __func__);
+		goto error;
+	}
+
+	orientationd_data->timer_fd = timer_fd;
+
+	orientationd_data->poll_fds[p].fd = timer_fd;
+	orientationd_data->poll_fds[p].events = POLLIN;
+	p++;
+
 	for (i = 0; i < orientationd_handlers_count; i++) {
 		if (orientationd_handlers[i] == NULL || orientationd_handlers[i]->input_name == NULL)
 			continue;
 
-		poll_fd = input_open(orientationd_handlers[i]->input_name);
+		poll_fd = input_index_open(orientationd_handlers[i]->input_name,
+			O_RDONLY | O_NONBLOCK, NULL, 0);
 		if (poll_fd < 0) {
 			ALOGE("%s: Unable to open input %s", __func__, orientationd_handlers[i]->input_name);
 			continue;
@@ -281,20 +381,6 @@ int main(int argc __unused, char *argv[] __unused)
 
 	orientationd_data->poll_fds_count = p;
 
-	orientationd_data->thread_continue = 1;
-
-	pthread_mutex_init(&orientationd_data->mutex, NULL);
-	pthread_mutex_lock(&orientationd_data->mutex);
-
-	pthread_attr_init(&thread_attr);
-	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
-
-	rc = pthread_create(&orientationd_data->thread, &thread_attr, orientationd_thread, (void *) orientationd_data);
-	if (rc < 0) {
-		ALOGE("%s: Unable to create orientationd thread", __func__);
-		goto error;
-	}
-
 	rc = orientationd_poll(orientationd_data);
 	if (rc < 0)
 		goto error;
@@ -312,10 +398,10 @@ complete:
 	if (input_fd >= 0)
 		close(input_fd);
 
-	if (orientationd_data != NULL) {
-		orientationd_data->thread_continue = 0;
-		pthread_mutex_destroy(&orientationd_data->mutex);
+	if (timer_fd >= 0)
+		close(timer_fd);
 
+	if (orientationd_data != NULL) {
 		if (orientationd_data->poll_fds != NULL)
 			free(orientationd_data->poll_fds);
 
@@ -27,13 +27,57 @@
 #ifndef _ORIENTATIOND_H_
 #define _ORIENTATIOND_H_
 
+/* Events read from an input device per syscall */
+#define ORIENTATIOND_EVENTS_MAX		64
+
+/* Frames kept per sensor to interpolate from */
+#define ORIENTATIOND_HISTORY		4
+
+/*
+ * The filtered attitude also goes out as a quaternion, each component
+ * scaled by ORIENTATIOND_QUATERNION_SCALE, when the orientation input
+ * device declares these codes. It is there for the other readers of the
+ * device, the HAL only reports the angles.
+ */
+#define ORIENTATIOND_ABS_QUATERNION_X	ABS_RX
+#define ORIENTATIOND_ABS_QUATERNION_Y	ABS_RY
+#define ORIENTATIOND_ABS_QUATERNION_Z	ABS_RZ
+#define ORIENTATIOND_ABS_QUATERNION_W	ABS_RUDDER
+#define ORIENTATIOND_QUATERNION_SCALE	1000000
+
+/* Time constant of the filter, in ms, 0 for the raw angles */
+#define ORIENTATIOND_FILTER_PROPERTY	"persist.sensors.orientation.filter"
+#define ORIENTATIOND_FILTER_DEFAULT	"250"
+
 struct orientationd_data;
 
+struct orientationd_sample {
+	sensors_vec_t value;
+	int64_t timestamp;
+};
+
+struct orientationd_history {
+	struct orientationd_sample samples[ORIENTATIOND_HISTORY];
+	int head;
+	int count;
+};
+
+struct orientationd_filter {
+	float q[4];
+	int64_t timestamp;
+	float time_constant;
+	int valid;
+};
+
 struct orientationd_handlers {
 	char *input_name;
 	int handle;
 	int poll_fd;
 
+	/* values of the device, added to the history at each EV_SYN */
+	sensors_vec_t frame;
+
+	/* count of whole frames read, 0 if none is left to read */
 	int (*get_data)(struct orientationd_handlers *handlers,
 		struct orientationd_data *data);
 };
@@ -49,14 +93,35 @@ struct orientationd_data {
 	sensors_vec_t acceleration;
 	sensors_vec_t magnetic;
 
+	/*
+	 * The sensors run at their own rates: acceleration and magnetic are
+	 * interpolated from the frames, stamped with their evdev times, to
+	 * the latest time both have frames for before each orientation
+	 * sample, the time of the last sample being kept.
+	 */
+	struct orientationd_history acceleration_history;
+	struct orientationd_history magnetic_history;
+	int64_t timestamp;
+
+	/* smooths the angles when its time constant is set */
+	struct orientationd_filter filter;
+
+	/* the input device declares the quaternion codes */
+	int quaternion;
+
 	int64_t delay;
 	int input_fd;
+	int timer_fd;
 
 	int activated;
 
-	pthread_t thread;
-	pthread_mutex_t mutex;
-	int thread_continue;
+	/*
+	 * An orientation sample is computed when a sensor frame arrived since
+	 * the last one (fresh), at most once per delay: while the timer runs
+	 * (waiting), new frames wait for it to expire.
+	 */
+	int fresh;
+	int waiting;
 };
 
 extern struct orientationd_handlers *orientationd_handlers[];
@@ -67,8 +132,44 @@ extern int orientationd_handlers_count;
  */
 
 void input_event_set(struct input_event *event, int type, int code, int value);
+int input_events_read(int fd, struct input_event *events, int count);
+int input_abs_declared(int fd, const int *codes, int count);
 int64_t timestamp(struct timeval *time);
-int input_open(char *name);
+
+/*
+ * Orientation
+ */
+
+void orientation_compute(const sensors_vec_t *a, const sensors_vec_t *m,
+	sensors_vec_t *o);
+void orientation_compute_batch(const sensors_vec_t *a, const sensors_vec_t *m,
+	sensors_vec_t *o, int count);
+void orientation_quaternion(const float q[4], sensors_vec_t *o);
+
+/*
+ * Filter
+ */
+
+void filter_reset(struct orientationd_filter *filter);
+int filter_update(struct orientationd_filter *filter,
+	const sensors_vec_t *acceleration, const sensors_vec_t *magnetic,
+	int64_t timestamp);
+void filter_orientation(struct orientationd_filter *filter, sensors_vec_t *o);
+
+/*
+ * History
+ */
+
+void history_reset(struct orientationd_history *history);
+void history_push(struct orientationd_history *history, sensors_vec_t *value,
+	int64_t timestamp);
+int64_t history_newest(struct orientationd_history *history);
+int64_t history_common(struct orientationd_history *a,
+	struct orientationd_history *b);
+int history_lerp(struct orientationd_history *history, int64_t timestamp,
+	sensors_vec_t *value);
+int history_slerp(struct orientationd_history *history, int64_t timestamp,
+	sensors_vec_t *value);
 
 /*
  * Sensors
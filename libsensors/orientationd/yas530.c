@@ -41,9 +41,11 @@ float yas530_convert(int value)
 int yas530_get_data(struct orientationd_handlers *handlers,
 	struct orientationd_data *data)
 {
-	struct input_event input_event;
+	struct input_event input_events[ORIENTATIOND_EVENTS_MAX];
 	int input_fd;
-	int rc;
+	int frames;
+	int count;
+	int i;
 
 	if (handlers == NULL || data == NULL)
 		return -EINVAL;
@@ -52,29 +54,33 @@ int yas530_get_data(struct orientationd_handlers *handlers,
 	if (input_fd < 0)
 		return -1;
 
-	do {
-		rc = read(input_fd, &input_event, sizeof(input_event));
-		if (rc < (int) sizeof(input_event))
-			break;
+	count = input_events_read(input_fd, input_events, ORIENTATIOND_EVENTS_MAX);
+	if (count < 0)
+		return -1;
+
+	frames = 0;
 
-		if (input_event.type == EV_ABS) {
-			switch (input_event.code) {
+	for (i = 0; i < count; i++) {
+		if (input_events[i].type == EV_ABS) {
+			switch (input_events[i].code) {
 				case ABS_X:
-					data->magnetic.x = yas530_convert(input_event.value);
+					handlers->frame.x = yas530_convert(input_events[i].value);
 					break;
 				case ABS_Y:
-					data->magnetic.y = yas530_convert(input_event.value);
+					handlers->frame.y = yas530_convert(input_events[i].value);
 					break;
 				case ABS_Z:
-					data->magnetic.z = yas530_convert(input_event.value);
+					handlers->frame.z = yas530_convert(input_events[i].value);
 					break;
-				default:
-					continue;
 			}
+		} else if (input_events[i].type == EV_SYN) {
+			history_push(&data->magnetic_history, &handlers->frame,
+				timestamp(&input_events[i].time));
+			frames++;
 		}
-	} while (input_event.type != EV_SYN);
+	}
 
-	return 0;
+	return frames;
 }
 
 struct orientationd_handlers yas530 = {
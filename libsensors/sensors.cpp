@@ -24,10 +24,13 @@
 #include <dirent.h>
 #include <math.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <cstring>
 
+#include <cutils/properties.h>
 #include <utils/Atomic.h>
 #include <utils/Log.h>
 
@@ -35,11 +38,69 @@
 
 #include "LightSensor.h"
 #include "ProximitySensor.h"
+#ifndef SENSORS_HAL_ORIENTATION
 #include "OrientationSensor.h"
+#endif
 #include "MagneticSensor.h"
 #include "AccelerationSensor.h"
+#include "SensorEventFifo.h"
+#include "SensorFusion.h"
+#include "DeviceOrientation.h"
+#include "SensorBackend.h"
+#include "SensorStats.h"
+#include "DirectChannel.h"
+#include "SensorTrace.h"
 
-#define LOCAL_SENSORS (5)
+#define LOCAL_SENSORS (11)
+
+/* Software FIFO depth of each batched sensor */
+#define BATCH_FIFO_EVENTS (512)
+
+/* Queue depth of the sensors that are delivered right away */
+#define DIRECT_FIFO_EVENTS (64)
+
+/* Shared memory channels clients can register for direct reports */
+#define MAX_DIRECT_CHANNELS (4)
+
+/* Sensors that can be reported through a direct channel */
+#define DIRECT_REPORT_HANDLES (HANDLE_BIT(ID_A) | HANDLE_BIT(ID_M))
+
+/*
+ * Direct report flags of a sensor whose fastest rate is the given
+ * SENSOR_DIRECT_RATE_* level. The three axis drivers take at most 100 Hz
+ * (ThreeAxisTraits::delayValue), which only covers the normal level.
+ */
+#ifdef SENSORS_DEVICE_API_VERSION_1_4
+#define DIRECT_REPORT_FLAGS(rate) (SENSOR_FLAG_DIRECT_CHANNEL_ASHMEM | \
+        ((rate) << SENSOR_FLAG_SHIFT_DIRECT_REPORT))
+#else
+#define DIRECT_REPORT_FLAGS(rate) (0)
+#endif
+
+/* Sampling period of a sensor activated without a rate, SENSOR_DELAY_NORMAL */
+#define DEFAULT_DELAY_NS (200000000LL)
+
+/*
+ * Accelerometer rate the device orientation is judged at, whatever the
+ * framework asks for the on-change sensor: SENSOR_DELAY_UI, like the
+ * WindowOrientationListener it stands in for
+ */
+#define DEVICE_ORIENTATION_DELAY_NS (66667000LL)
+
+/* Accelerometer position init.espresso.variant.sh sets on P31xx */
+#define ACCEL_DISPLAY_POSITION (6)
+
+/*
+ * The runtime statistics are written to SENSORS_STATS_FILE each time
+ * debug.sensors.stats.dump takes a new value, and every
+ * persist.sensors.stats.interval seconds if set. The poll thread looks
+ * at both once a second.
+ */
+#define STATS_DUMP_PROPERTY "debug.sensors.stats.dump"
+#define STATS_INTERVAL_PROPERTY "persist.sensors.stats.interval"
+#define STATS_CHECK_INTERVAL_NS (1000000000LL)
+
+#define HANDLE_BIT(handle) (1U << (handle))
 
 static struct sensor_t sSensorList[LOCAL_SENSORS] = {
 	{
@@ -52,12 +113,12 @@ static struct sensor_t sSensorList[LOCAL_SENSORS] = {
 		.resolution = GRAVITY_EARTH / 256.0f,
 		.power = 0.13f,
 		.minDelay = 0,
-		.fifoReservedEventCount = 0,
-		.fifoMaxEventCount = 0,
+		.fifoReservedEventCount = BATCH_FIFO_EVENTS,
+		.fifoMaxEventCount = BATCH_FIFO_EVENTS,
 		.stringType = 0,
 		.requiredPermission = 0,
 		.maxDelay = 125000,
-		.flags = SENSOR_FLAG_CONTINUOUS_MODE,
+		.flags = SENSOR_FLAG_CONTINUOUS_MODE | DIRECT_REPORT_FLAGS(SENSOR_DIRECT_RATE_NORMAL),
 		{ 0 },
 	},
 	{
@@ -70,12 +131,12 @@ static struct sensor_t sSensorList[LOCAL_SENSORS] = {
 		.resolution = 0.3f,
 		.power = 4.0f,
 		.minDelay = 10000,
-		.fifoReservedEventCount = 0,
-		.fifoMaxEventCount = 0,
+		.fifoReservedEventCount = BATCH_FIFO_EVENTS,
+		.fifoMaxEventCount = BATCH_FIFO_EVENTS,
 		.stringType = 0,
 		.requiredPermission = 0,
 		.maxDelay = 125000,
-		.flags = SENSOR_FLAG_CONTINUOUS_MODE,
+		.flags = SENSOR_FLAG_CONTINUOUS_MODE | DIRECT_REPORT_FLAGS(SENSOR_DIRECT_RATE_NORMAL),
 		{ 0 },
 	},
 	{
@@ -88,8 +149,8 @@ static struct sensor_t sSensorList[LOCAL_SENSORS] = {
 		.resolution = 0.1f,
 		.power = 0.0f,
 		.minDelay = 10000,
-		.fifoReservedEventCount = 0,
-		.fifoMaxEventCount = 0,
+		.fifoReservedEventCount = BATCH_FIFO_EVENTS,
+		.fifoMaxEventCount = BATCH_FIFO_EVENTS,
 		.stringType = 0,
 		.requiredPermission = 0,
 		.maxDelay = 125000,
@@ -111,10 +172,119 @@ static struct sensor_t sSensorList[LOCAL_SENSORS] = {
 		.stringType = 0,
 		.requiredPermission = 0,
 		.maxDelay = 0,
+		.flags = SENSOR_FLAG_ON_CHANGE_MODE,
+		{ 0 },
+	},
+	/* Virtual sensors, computed from the accelerometer and magnetometer */
+	{
+		.name = "Rotation Vector Sensor",
+		.vendor = "Sensor Fusion",
+		.version = 1,
+		.handle = ID_RV,
+		.type = SENSOR_TYPE_ROTATION_VECTOR,
+		.maxRange = 1.0f,
+		.resolution = 1.0f / (1 << 24),
+		.power = 0.13f + 4.0f,
+		.minDelay = 10000,
+		.fifoReservedEventCount = 0,
+		.fifoMaxEventCount = 0,
+		.stringType = 0,
+		.requiredPermission = 0,
+		.maxDelay = 125000,
+		.flags = SENSOR_FLAG_CONTINUOUS_MODE,
+		{ 0 },
+	},
+	{
+		.name = "Game Rotation Vector Sensor",
+		.vendor = "Sensor Fusion",
+		.version = 1,
+		.handle = ID_GRV,
+		.type = SENSOR_TYPE_GAME_ROTATION_VECTOR,
+		.maxRange = 1.0f,
+		.resolution = 1.0f / (1 << 24),
+		.power = 0.13f,
+		.minDelay = 10000,
+		.fifoReservedEventCount = 0,
+		.fifoMaxEventCount = 0,
+		.stringType = 0,
+		.requiredPermission = 0,
+		.maxDelay = 125000,
 		.flags = SENSOR_FLAG_CONTINUOUS_MODE,
 		{ 0 },
 	},
-	{	/* P3100 only */
+	{
+		.name = "Gravity Sensor",
+		.vendor = "Sensor Fusion",
+		.version = 1,
+		.handle = ID_GRAV,
+		.type = SENSOR_TYPE_GRAVITY,
+		.maxRange = 2 * GRAVITY_EARTH,
+		.resolution = GRAVITY_EARTH / 256.0f,
+		.power = 0.13f,
+		.minDelay = 10000,
+		.fifoReservedEventCount = 0,
+		.fifoMaxEventCount = 0,
+		.stringType = 0,
+		.requiredPermission = 0,
+		.maxDelay = 125000,
+		.flags = SENSOR_FLAG_CONTINUOUS_MODE,
+		{ 0 },
+	},
+	{
+		.name = "Linear Acceleration Sensor",
+		.vendor = "Sensor Fusion",
+		.version = 1,
+		.handle = ID_LA,
+		.type = SENSOR_TYPE_LINEAR_ACCELERATION,
+		.maxRange = 2 * GRAVITY_EARTH,
+		.resolution = GRAVITY_EARTH / 256.0f,
+		.power = 0.13f,
+		.minDelay = 10000,
+		.fifoReservedEventCount = 0,
+		.fifoMaxEventCount = 0,
+		.stringType = 0,
+		.requiredPermission = 0,
+		.maxDelay = 125000,
+		.flags = SENSOR_FLAG_CONTINUOUS_MODE,
+		{ 0 },
+	},
+	{
+		.name = "Geomagnetic Rotation Vector Sensor",
+		.vendor = "Sensor Fusion",
+		.version = 1,
+		.handle = ID_GMRV,
+		.type = SENSOR_TYPE_GEOMAGNETIC_ROTATION_VECTOR,
+		.maxRange = 1.0f,
+		.resolution = 1.0f / (1 << 24),
+		.power = 0.13f + 4.0f,
+		.minDelay = 10000,
+		.fifoReservedEventCount = 0,
+		.fifoMaxEventCount = 0,
+		.stringType = 0,
+		.requiredPermission = 0,
+		.maxDelay = 125000,
+		.flags = SENSOR_FLAG_CONTINUOUS_MODE,
+		{ 0 },
+	},
+	{
+		.name = "Device Orientation Sensor",
+		.vendor = "Sensor Fusion",
+		.version = 1,
+		.handle = ID_DO,
+		.type = SENSOR_TYPE_DEVICE_ORIENTATION,
+		.maxRange = 3.0f,
+		.resolution = 1.0f,
+		.power = 0.13f,
+		.minDelay = 0,
+		.fifoReservedEventCount = 0,
+		.fifoMaxEventCount = 0,
+		.stringType = SENSOR_STRING_TYPE_DEVICE_ORIENTATION,
+		.requiredPermission = 0,
+		.maxDelay = 0,
+		.flags = SENSOR_FLAG_ON_CHANGE_MODE,
+		{ 0 },
+	},
+	{	/* P3100 only, must stay last */
 		.name = "GP2AP002 Proximity Sensor",
 		.vendor = "Sharp",
 		.version = 1,
@@ -165,14 +335,96 @@ struct sensors_module_t HAL_MODULE_INFO_SYM = {
     .set_operation_mode = NULL,
 };
 
+/*
+ * Sensors whose drivers must be running for a handle to produce events.
+ * The legacy orientation sensor is computed from the accelerometer and
+ * magnetometer, either in the HAL or by orientationd which reports it
+ * through its own input device.
+ */
+static uint32_t handleDependencies(int handle)
+{
+    switch (handle) {
+        case ID_A:
+        case ID_M:
+        case ID_L:
+        case ID_PX:
+            return HANDLE_BIT(handle);
+        case ID_O:
+#ifdef SENSORS_HAL_ORIENTATION
+            return HANDLE_BIT(ID_A) | HANDLE_BIT(ID_M);
+#else
+            return HANDLE_BIT(ID_O) | HANDLE_BIT(ID_A) | HANDLE_BIT(ID_M);
+#endif
+        case ID_GRV:
+        case ID_GRAV:
+        case ID_LA:
+        case ID_DO:
+            return HANDLE_BIT(ID_A);
+        case ID_RV:
+        case ID_GMRV:
+            return HANDLE_BIT(ID_A) | HANDLE_BIT(ID_M);
+    }
+    return 0;
+}
+
+static const struct sensor_t* handleToSensor(int handle)
+{
+    for (int i = 0; i < numSensors; i++) {
+        if (sSensorList[i].handle == handle)
+            return &sSensorList[i];
+    }
+    return NULL;
+}
+
+/*
+ * Quarter turns between the accelerometer axes and the display. On P31xx
+ * init.espresso.variant.sh turns the display with ro.sf.hwrotation and
+ * remaps the accelerometer to match through its position attribute; if
+ * that remap did not take, the samples still follow the panel and the
+ * device orientation has to be turned back by the hardware rotation.
+ */
+static int displayOffset()
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("ro.sf.hwrotation", value, "0");
+    int hwrotation = atoi(value);
+    if (!hwrotation)
+        return 0;
+
+    char path[PATH_MAX];
+    int position = -1;
+    if (!SensorBackend::get()->attributePath(AccelerationTraits::inputName(),
+            path, sizeof(path) - 8)) {
+        strcat(path, "position");
+        FILE* f = fopen(path, "r");
+        if (f) {
+            if (fscanf(f, "%d", &position) != 1)
+                position = -1;
+            fclose(f);
+        }
+    }
+
+    if (position == ACCEL_DISPLAY_POSITION)
+        return 0;
+
+    ALOGW("accelerometer position %d, turning the device orientation by %d",
+            position, hwrotation);
+    return hwrotation / 90;
+}
+
 struct sensors_poll_context_t {
-    struct sensors_poll_device_t device; // must be first
+    struct sensors_poll_device_1 device; // must be first
 
     sensors_poll_context_t();
     ~sensors_poll_context_t();
     int activate(int handle, int enabled);
     int setDelay(int handle, int64_t ns);
     int pollEvents(sensors_event_t* data, int count);
+    int batch(int handle, int flags, int64_t period_ns, int64_t timeout);
+    int flush(int handle);
+    int registerDirectChannel(int fd, size_t size);
+    int unregisterDirectChannel(int channel);
+    int configDirectReport(int handle, int channel, int64_t period_ns);
 
 private:
     enum {
@@ -181,23 +433,101 @@ private:
         magnetic,
         acceleration,
         proximity,
-        numSensorDrivers, // wake pipe goes here
+        numSensorDrivers, // wake eventfd goes here
         numFds,
     };
 
-    struct pollfd mPollFds[numFds];
     SensorBase* mSensors[numSensorDrivers];
 
-    static const size_t wake = numSensorDrivers;
-    static const char WAKE_MESSAGE = 'W';
-    int mWritePipeFd;
-
-    // For keeping track of usage (only count from system)
-    bool mAccelerationActive;
-    bool mMagneticActive;
-    bool mOrientationActive;
-
-    int real_activate(int handle, int enabled);
+    // Each driver fd is registered with a pointer to its mSensors slot,
+    // the wake eventfd with a NULL cookie. Drivers that still have data
+    // to read are kept in mReady.
+    int mEpollFd;
+    int mWakeFd;
+    uint32_t mReady;
+
+    // Wake-up sensors are read and delivered first
+    uint32_t mWakeUpHandles;
+    uint32_t mWakeUpDrivers;
+
+    // Handles activated by the framework. Physical sensors count the
+    // active handles depending on them and only run while that count is
+    // not zero, at the fastest rate any of them requested.
+    pthread_mutex_t mActivateLock;
+    volatile int32_t mActive;
+    int mRefCount[ID_MAX];
+    int64_t mRequestedDelay[ID_MAX];
+
+    // The framework threads only record the state the physical sensors
+    // should be in (mRefCount, mDriverDelay) and flag them in
+    // mDriverChanges; the poll thread then does the sysfs writes, so a
+    // slow driver never blocks activate() and a burst of requests comes
+    // down to its final state. mDriverEnabled and mAppliedDelay are what
+    // the drivers were last set to, only touched by the poll thread.
+    int64_t mDriverDelay[ID_MAX];
+    volatile int32_t mDriverChanges;
+    bool mDriverEnabled[ID_MAX];
+    int64_t mAppliedDelay[ID_MAX];
+
+    // Handles waiting for their first sample since activate(), for the
+    // startup latency statistics
+    volatile int32_t mAwaitingSample;
+    int64_t mEnableTime[ID_MAX];
+
+    // Direct report channels, indexed by channel handle - 1. A handle
+    // reported on any channel counts as one more user of its driver,
+    // running at the fastest channel rate (mDirectDelay, 0 if none).
+    pthread_mutex_t mDirectLock;
+    DirectChannel* mDirectChannels[MAX_DIRECT_CHANNELS];
+    volatile int32_t mDirectHandles;
+    int64_t mDirectDelay[ID_MAX];
+
+    // Event queues and batching state, indexed by handle. Latency and
+    // flush requests come from the framework threads, the FIFOs are only
+    // touched by poll.
+    pthread_mutex_t mBatchLock;
+    SensorEventFifo* mFifo[ID_MAX];
+    int64_t mBatchLatency[ID_MAX];
+    int64_t mBatchDeadline[ID_MAX];
+    int mFlushPending[ID_MAX];
+
+    // Drivers run at the rate of their fastest user, continuous handles
+    // are decimated back to the period they asked for, mLastEvent being
+    // the time the last kept sample was due at
+    int64_t mEventPeriod[ID_MAX];
+    int64_t mLastEvent[ID_MAX];
+    sensors_event_t mScratch[32];
+
+    // Handles whose FIFO is overflowing, only touched by poll: the
+    // overrun is logged once when it starts, FIFO_OVERRUNS counts it all
+    uint32_t mOverrunHandles;
+
+    int64_t mNextStatsCheck;
+    int64_t mNextStatsWrite;
+    char mStatsDump[PROPERTY_VALUE_MAX];
+
+    SensorFusion mFusion;
+
+    // Device orientation judge, only touched by poll. activate() flags
+    // mRotationReset so that every activation starts from scratch and
+    // reports the rotation the device is in.
+    DeviceOrientation mDeviceOrientation;
+    volatile int32_t mRotationReset;
+
+    void addSensor(int index, SensorBase* sensor);
+    SensorBase* driverFor(int handle) const;
+    int real_activate(int handle, bool enabled, int64_t ns);
+    void applyDriverChanges();
+    int updateDelay(int handle);
+    int updateDirectReport(int handle);
+    void wakePoll();
+    void dispatch(const sensors_event_t& event);
+    void queueFused(int handle, int64_t timestamp);
+    void queueRotation(int64_t timestamp);
+    void checkStats(int64_t now);
+    void queueEvent(const sensors_event_t& event);
+    int drainFifos(sensors_event_t* data, int count, int64_t now);
+    int nextBatchTimeout(int64_t now);
 
     int handleToDriver(int handle) const {
         switch (handle) {
@@ -205,8 +535,10 @@ private:
                 return acceleration;
             case ID_M:
                 return magnetic;
+#ifndef SENSORS_HAL_ORIENTATION
             case ID_O:
                 return orientation;
+#endif
             case ID_L:
                 return light;
             case ID_PX:
@@ -214,6 +546,13 @@ private:
         }
         return -EINVAL;
     }
+
+    static int64_t now() {
+        struct timespec t;
+        t.tv_sec = t.tv_nsec = 0;
+        clock_gettime(CLOCK_BOOTTIME, &t);
+        return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+    }
 };
 
 sensors_poll_context_t::sensors_poll_context_t()
@@ -228,6 +567,30 @@ sensors_poll_context_t::sensors_poll_context_t()
 
     // must clean this up early or else the destructor will make a mess
     memset(mSensors, 0, sizeof(mSensors));
+    memset(mFifo, 0, sizeof(mFifo));
+    memset(mBatchLatency, 0, sizeof(mBatchLatency));
+    memset(mBatchDeadline, 0, sizeof(mBatchDeadline));
+    memset(mEventPeriod, 0, sizeof(mEventPeriod));
+    memset(mLastEvent, 0, sizeof(mLastEvent));
+    memset(mFlushPending, 0, sizeof(mFlushPending));
+    pthread_mutex_init(&mBatchLock, NULL);
+    pthread_mutex_init(&mActivateLock, NULL);
+    pthread_mutex_init(&mDirectLock, NULL);
+    memset(mDirectChannels, 0, sizeof(mDirectChannels));
+    memset(mDirectDelay, 0, sizeof(mDirectDelay));
+    mDirectHandles = 0;
+    mActive = 0;
+    memset(mRefCount, 0, sizeof(mRefCount));
+    for (int i = 0; i < ID_MAX; i++) {
+        mRequestedDelay[i] = DEFAULT_DELAY_NS;
+        mDriverDelay[i] = -1;
+        mAppliedDelay[i] = -1;
+    }
+    mRequestedDelay[ID_DO] = DEVICE_ORIENTATION_DELAY_NS;
+    mDriverChanges = 0;
+    memset(mDriverEnabled, 0, sizeof(mDriverEnabled));
+    mAwaitingSample = 0;
+    memset(mEnableTime, 0, sizeof(mEnableTime));
 
     char device[16];
     FILE *f = fopen(DEVICE_VARIANT_SYSFS, "r");
@@ -253,184 +616,913 @@ sensors_poll_context_t::sensors_poll_context_t()
         hasProximity = true;
     }
 
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    ALOGE_IF(mEpollFd < 0, "error creating epoll fd (%s)", strerror(errno));
+
+    /* Timer based sensor initialization */
+    mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ALOGE_IF(mWakeFd < 0, "error creating wake eventfd (%s)", strerror(errno));
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    int result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &event);
+    ALOGE_IF(result < 0, "error adding wake eventfd (%s)", strerror(errno));
+
+    mReady = 0;
+    mNextStatsCheck = 0;
+    mNextStatsWrite = 0;
+    property_get(STATS_DUMP_PROPERTY, mStatsDump, "");
+    mRotationReset = 0;
+    mWakeUpHandles = 0;
+    mWakeUpDrivers = 0;
+    mOverrunHandles = 0;
+
     if (hasProximity) {
-        mSensors[proximity] = new ProximitySensor();
-        mPollFds[proximity].fd = mSensors[proximity]->getFd();
-        mPollFds[proximity].events = POLLIN;
-        mPollFds[proximity].revents = 0;
+        addSensor(proximity, new ProximitySensor());
     } else {
         numSensors -= 1;
     }
 
-    mSensors[light] = new LightSensor(lightSensorType);
-    mPollFds[light].fd = mSensors[light]->getFd();
-    mPollFds[light].events = POLLIN;
-    mPollFds[light].revents = 0;
+    addSensor(light, new LightSensor(LightTraits(lightSensorType)));
+    addSensor(acceleration, new AccelerationSensor());
+    mDeviceOrientation.setOffset(displayOffset());
+    addSensor(magnetic, new MagneticSensor());
+#ifndef SENSORS_HAL_ORIENTATION
+    addSensor(orientation, new OrientationSensor());
+#endif
+
+    // batched sensors get a deep FIFO, everything else a short queue
+    for (int i = 0; i < numSensors; i++) {
+        const struct sensor_t* sensor = &sSensorList[i];
+        mFifo[sensor->handle] = new SensorEventFifo(sensor->fifoMaxEventCount ?
+                sensor->fifoMaxEventCount : DIRECT_FIFO_EVENTS);
+
+        if (sensor->flags & SENSOR_FLAG_WAKE_UP) {
+            int index = handleToDriver(sensor->handle);
+            mWakeUpHandles |= HANDLE_BIT(sensor->handle);
+            if (index >= 0)
+                mWakeUpDrivers |= 1 << index;
+        }
+    }
 
-    mSensors[acceleration] = new AccelerationSensor();
-    mPollFds[acceleration].fd = mSensors[acceleration]->getFd();
-    mPollFds[acceleration].events = POLLIN;
-    mPollFds[acceleration].revents = 0;
+    ALOGV("%s-", __PRETTY_FUNCTION__);
+}
 
-    mSensors[magnetic] = new MagneticSensor();
-    mPollFds[magnetic].fd = mSensors[magnetic]->getFd();
-    mPollFds[magnetic].events = POLLIN;
-    mPollFds[magnetic].revents = 0;
+sensors_poll_context_t::~sensors_poll_context_t()
+{
+    // the poll thread is gone, power down what was deactivated last
+    applyDriverChanges();
+
+    for (int i = 0; i < numSensorDrivers; i++)
+        delete mSensors[i];
+    for (int i = 0; i < ID_MAX; i++)
+        delete mFifo[i];
+    for (int i = 0; i < MAX_DIRECT_CHANNELS; i++)
+        delete mDirectChannels[i];
+    // complete the trace with its index
+    if (SensorTraceWriter::get())
+        SensorTraceWriter::get()->close();
+    close(mWakeFd);
+    close(mEpollFd);
+    pthread_mutex_destroy(&mBatchLock);
+    pthread_mutex_destroy(&mActivateLock);
+    pthread_mutex_destroy(&mDirectLock);
+}
 
-    mSensors[orientation] = new OrientationSensor();
-    mPollFds[orientation].fd = mSensors[orientation]->getFd();
-    mPollFds[orientation].events = POLLIN;
-    mPollFds[orientation].revents = 0;
+void sensors_poll_context_t::addSensor(int index, SensorBase* sensor)
+{
+    mSensors[index] = sensor;
+
+    int fd = sensor->getFd();
+    if (fd < 0)
+        return;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = &mSensors[index];
+    int result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event);
+    ALOGE_IF(result < 0, "error adding fd %d to epoll (%s)", fd, strerror(errno));
+}
 
-    /* Timer based sensor initialization */
-    int wakeFds[2];
-    int result = pipe(wakeFds);
-    ALOGE_IF(result < 0, "error creating wake pipe (%s)", strerror(errno));
-    fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
-    fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
-    mWritePipeFd = wakeFds[1];
+int sensors_poll_context_t::activate(int handle, int enabled)
+{
+    ALOGV("%s+: %d, %d", __PRETTY_FUNCTION__, handle, enabled);
 
-    mPollFds[wake].fd = wakeFds[0];
-    mPollFds[wake].events = POLLIN;
-    mPollFds[wake].revents = 0;
+    if (!handleToSensor(handle))
+        return -EINVAL;
+
+    SensorStats::count(handle, SensorStats::ACTIVATE_CALLS);
+
+    // A disabled sensor stops batching, whatever is left in its FIFO
+    // gets delivered on the next poll. A newly enabled one reports its
+    // first sample whatever the decimation.
+    pthread_mutex_lock(&mBatchLock);
+    if (!enabled)
+        mBatchLatency[handle] = 0;
+    else
+        mLastEvent[handle] = 0;
+    pthread_mutex_unlock(&mBatchLock);
 
-    mAccelerationActive = false;
-    mMagneticActive = false;
-    mOrientationActive = false;
+    pthread_mutex_lock(&mActivateLock);
+
+    uint32_t active = mActive;
+    if (!enabled == !(active & HANDLE_BIT(handle))) {
+        pthread_mutex_unlock(&mActivateLock);
+        return 0;
+    }
+
+    uint32_t required = handleDependencies(handle);
+    if (enabled) {
+        // the drivers are only written later, refuse what can't work now
+        for (int h = 1; h < ID_MAX; h++) {
+            if ((required & HANDLE_BIT(h)) && !driverFor(h)) {
+                pthread_mutex_unlock(&mActivateLock);
+                return -ENODEV;
+            }
+        }
+
+        android_atomic_release_store(active | HANDLE_BIT(handle), &mActive);
+        for (int h = 1; h < ID_MAX; h++) {
+            if (!(required & HANDLE_BIT(h)))
+                continue;
+            mRefCount[h]++;
+            updateDelay(h);
+        }
+
+        mEnableTime[handle] = now();
+        android_atomic_or(HANDLE_BIT(handle), &mAwaitingSample);
+        if (handle == ID_DO)
+            android_atomic_release_store(1, &mRotationReset);
+    } else {
+        android_atomic_release_store(active & ~HANDLE_BIT(handle), &mActive);
+        android_atomic_and(~HANDLE_BIT(handle), &mAwaitingSample);
+
+        for (int h = 1; h < ID_MAX; h++) {
+            if (!(required & HANDLE_BIT(h)) || !mRefCount[h])
+                continue;
+            mRefCount[h]--;
+            updateDelay(h);
+        }
+    }
+
+    pthread_mutex_unlock(&mActivateLock);
+
+    wakePoll();
 
     ALOGV("%s-", __PRETTY_FUNCTION__);
+
+    return 0;
 }
 
-sensors_poll_context_t::~sensors_poll_context_t()
+SensorBase* sensors_poll_context_t::driverFor(int handle) const
+{
+    int index = handleToDriver(handle);
+    if (index < 0 || !mSensors[index] || mSensors[index]->getFd() < 0)
+        return NULL;
+    return mSensors[index];
+}
+
+/*
+ * Set a physical sensor to the rate, then the power state, it should be
+ * in. Runs on the poll thread.
+ */
+int sensors_poll_context_t::real_activate(int handle, bool enabled, int64_t ns)
 {
-    for (int i = 0; i < numSensorDrivers; i++) {
-        if (mSensors[i]) {
-            delete mSensors[i];
-            close(mPollFds[i].fd);
+    ALOGV("%s+: %d, %d", __PRETTY_FUNCTION__, handle, enabled);
+
+    int index = handleToDriver(handle);
+    if (index < 0 || !mSensors[index])
+        return -EINVAL;
+
+    SensorBase* const sensor(mSensors[index]);
+    int err = 0;
+
+    // set the rate first so that the first samples come at it
+    if (enabled && ns >= 0 && ns != mAppliedDelay[handle]) {
+        err = sensor->setDelay(handle, ns);
+        if (!err)
+            mAppliedDelay[handle] = ns;
+    }
+
+    if (!err && enabled != mDriverEnabled[handle]) {
+        err = sensor->enable(handle, enabled);
+        if (!err) {
+            mDriverEnabled[handle] = enabled;
+            // enabling may have queued an initial event, have it picked up
+            if (sensor->hasPendingEvents())
+                mReady |= 1 << index;
         }
     }
-    close(mWritePipeFd);
+
+    if (err) {
+        ALOGE("couldn't %s handle %d (%d)", enabled ? "enable" : "disable", handle, err);
+        SensorStats::count(handle, SensorStats::DRIVER_ERRORS);
+    }
+
+    ALOGV("%s-", __PRETTY_FUNCTION__);
+
+    return err;
 }
 
-int sensors_poll_context_t::activate(int handle, int enabled)
+void sensors_poll_context_t::applyDriverChanges()
 {
-    int err;
+    if (!android_atomic_acquire_load(&mDriverChanges))
+        return;
 
-    ALOGV("%s+: %d, %d", __PRETTY_FUNCTION__, handle, enabled);
+    uint32_t changes = android_atomic_and(0, &mDriverChanges);
+    for (; changes; changes &= changes - 1) {
+        int h = __builtin_ctz(changes);
+
+        pthread_mutex_lock(&mActivateLock);
+        bool enabled = mRefCount[h] > 0;
+        int64_t ns = mDriverDelay[h];
+        pthread_mutex_unlock(&mActivateLock);
+
+        real_activate(h, enabled, ns);
+    }
+}
+
+void sensors_poll_context_t::wakePoll()
+{
+    const uint64_t wakeMessage = 1;
+    int result = write(mWakeFd, &wakeMessage, sizeof(wakeMessage));
+    ALOGE_IF(result < 0,
+            "error sending wake message (%s)", strerror(errno));
+}
+
+/*
+ * Have a physical sensor programmed with the shortest delay requested by
+ * the active handles using it, and with its power state, called with
+ * mActivateLock held.
+ */
+int sensors_poll_context_t::updateDelay(int handle)
+{
+    int index = handleToDriver(handle);
+    if (index < 0 || !mSensors[index])
+        return -EINVAL;
+
+    uint32_t active = mActive;
+    int64_t ns = -1;
+    for (int h = 1; h < ID_MAX; h++) {
+        if ((active & HANDLE_BIT(h)) && (handleDependencies(h) & HANDLE_BIT(handle)) &&
+                (ns < 0 || mRequestedDelay[h] < ns))
+            ns = mRequestedDelay[h];
+    }
+
+    if (mDirectDelay[handle] && (ns < 0 || mDirectDelay[handle] < ns))
+        ns = mDirectDelay[handle];
+
+    if (ns >= 0)
+        mDriverDelay[handle] = ns;
+    android_atomic_or(HANDLE_BIT(handle), &mDriverChanges);
+
+    return 0;
+}
+
+int sensors_poll_context_t::setDelay(int handle, int64_t ns)
+{
+    int err = 0;
+
+    ALOGV("%s+: %d", __PRETTY_FUNCTION__, handle);
+
+    const struct sensor_t* sensor = handleToSensor(handle);
+    uint32_t required = handleDependencies(handle);
+    if (!sensor || !required)
+        return -EINVAL;
+
+    SensorStats::count(handle, SensorStats::SET_DELAY_CALLS);
 
-    // Orientation requires accelerometer and magnetic sensor
-    if (handle == ID_O) {
-        mOrientationActive = enabled ? true : false;
-        if (!mAccelerationActive) {
-            err = real_activate(ID_A, enabled);
-            if (err)
-            	return err;
+    // on-change and one-shot sensors report every event they get
+    pthread_mutex_lock(&mBatchLock);
+    bool continuous = (sensor->flags & REPORTING_MODE_MASK) == SENSOR_FLAG_CONTINUOUS_MODE;
+    mEventPeriod[handle] = continuous ? ns : 0;
+    pthread_mutex_unlock(&mBatchLock);
+
+    pthread_mutex_lock(&mActivateLock);
+
+    // the device orientation runs the accelerometer at its own rate
+    mRequestedDelay[handle] = handle == ID_DO ? DEVICE_ORIENTATION_DELAY_NS : ns;
+    for (int h = 1; !err && h < ID_MAX; h++) {
+        if (required & HANDLE_BIT(h))
+            err = updateDelay(h);
+    }
+
+    pthread_mutex_unlock(&mActivateLock);
+
+    wakePoll();
+
+    ALOGV("%s-", __PRETTY_FUNCTION__);
+
+    return err;
+}
+
+/*
+ * Account for the direct channels reporting a handle after one of them
+ * changed, called with mActivateLock held
+ */
+int sensors_poll_context_t::updateDirectReport(int handle)
+{
+    int64_t ns = 0;
+
+    pthread_mutex_lock(&mDirectLock);
+    for (int i = 0; i < MAX_DIRECT_CHANNELS; i++) {
+        int64_t period = mDirectChannels[i] ? mDirectChannels[i]->period(handle) : 0;
+        if (period && (!ns || period < ns))
+            ns = period;
+    }
+    if (ns)
+        android_atomic_or(HANDLE_BIT(handle), &mDirectHandles);
+    else
+        android_atomic_and(~HANDLE_BIT(handle), &mDirectHandles);
+    pthread_mutex_unlock(&mDirectLock);
+
+    int64_t old = mDirectDelay[handle];
+    mDirectDelay[handle] = ns;
+
+    if (ns && !old)
+        mRefCount[handle]++;
+    else if (!ns && old)
+        mRefCount[handle]--;
+
+    return updateDelay(handle);
+}
+
+int sensors_poll_context_t::registerDirectChannel(int fd, size_t size)
+{
+    int channel = -ENOMEM;
+
+    ALOGV("%s+: %d, %zu", __PRETTY_FUNCTION__, fd, size);
+
+    pthread_mutex_lock(&mDirectLock);
+    for (int i = 0; i < MAX_DIRECT_CHANNELS; i++) {
+        if (mDirectChannels[i])
+            continue;
+
+        DirectChannel* direct = new DirectChannel();
+        channel = direct->init(fd, size);
+        if (channel < 0) {
+            delete direct;
+            break;
         }
-        if (!mMagneticActive) {
-            err = real_activate(ID_M, enabled);
-            if (err)
-            	return err;
+
+        mDirectChannels[i] = direct;
+        channel = i + 1;
+        break;
+    }
+    pthread_mutex_unlock(&mDirectLock);
+
+    ALOGV("%s-", __PRETTY_FUNCTION__);
+
+    return channel;
+}
+
+int sensors_poll_context_t::unregisterDirectChannel(int channel)
+{
+    ALOGV("%s+: %d", __PRETTY_FUNCTION__, channel);
+
+    if (channel < 1 || channel > MAX_DIRECT_CHANNELS)
+        return -EINVAL;
+
+    pthread_mutex_lock(&mActivateLock);
+
+    pthread_mutex_lock(&mDirectLock);
+    delete mDirectChannels[channel - 1];
+    mDirectChannels[channel - 1] = NULL;
+    pthread_mutex_unlock(&mDirectLock);
+
+    for (int h = 1; h < ID_MAX; h++) {
+        if (DIRECT_REPORT_HANDLES & HANDLE_BIT(h))
+            updateDirectReport(h);
+    }
+
+    pthread_mutex_unlock(&mActivateLock);
+
+    wakePoll();
+
+    ALOGV("%s-", __PRETTY_FUNCTION__);
+
+    return 0;
+}
+
+/*
+ * Start, retune or stop (period_ns 0) the direct report of a handle on
+ * a channel, handle -1 stops all of them. Returns the report token.
+ */
+int sensors_poll_context_t::configDirectReport(int handle, int channel,
+        int64_t period_ns)
+{
+    int err = 0;
+
+    ALOGV("%s+: %d, %d, %lld", __PRETTY_FUNCTION__, handle, channel, (long long) period_ns);
+
+    if (channel < 1 || channel > MAX_DIRECT_CHANNELS)
+        return -EINVAL;
+
+    uint32_t handles;
+    if (handle == -1 && !period_ns)
+        handles = DIRECT_REPORT_HANDLES;
+    else if (handle > 0 && handle < ID_MAX && (DIRECT_REPORT_HANDLES & HANDLE_BIT(handle)))
+        handles = HANDLE_BIT(handle);
+    else
+        return -EINVAL;
+
+    pthread_mutex_lock(&mActivateLock);
+
+    // the drivers are only written later, refuse what can't work now
+    for (int h = 1; period_ns && h < ID_MAX; h++) {
+        if ((handles & HANDLE_BIT(h)) && !driverFor(h)) {
+            pthread_mutex_unlock(&mActivateLock);
+            return -ENODEV;
         }
     }
-    // Keep track of magnetic and accelerometer use from system
-    else if (handle == ID_A) {
-        mAccelerationActive = enabled ? true : false;
-        // No need to enable or disable if orientation sensor is active as that will handle it
-        if (mOrientationActive)
-        	return 0;
+
+    pthread_mutex_lock(&mDirectLock);
+    DirectChannel* const direct(mDirectChannels[channel - 1]);
+    if (direct) {
+        for (int h = 1; h < ID_MAX; h++) {
+            if (handles & HANDLE_BIT(h))
+                direct->setPeriod(h, period_ns);
+        }
     }
-    else if (handle == ID_M) {
-        mMagneticActive = enabled ? true : false;
-        // No need to enable or disable if orientation sensor is active as that will handle it
-        if (mOrientationActive)
-        	return 0;
+    pthread_mutex_unlock(&mDirectLock);
+
+    if (!direct) {
+        pthread_mutex_unlock(&mActivateLock);
+        return -EINVAL;
+    }
+
+    for (int h = 1; !err && h < ID_MAX; h++) {
+        if (handles & HANDLE_BIT(h))
+            err = updateDirectReport(h);
     }
 
+    pthread_mutex_unlock(&mActivateLock);
+
+    wakePoll();
+
     ALOGV("%s-", __PRETTY_FUNCTION__);
 
-    return real_activate(handle, enabled);
+    if (err)
+        return err;
+
+    // the handle itself is the report token
+    return period_ns ? handle : 0;
 }
 
-int sensors_poll_context_t::real_activate(int handle, int enabled)
+int sensors_poll_context_t::batch(int handle, int flags __unused,
+        int64_t period_ns, int64_t timeout)
 {
-    ALOGV("%s+: %d, %d", __PRETTY_FUNCTION__, handle, enabled);
+    ALOGV("%s+: %d, %lld, %lld", __PRETTY_FUNCTION__, handle, (long long) period_ns, (long long) timeout);
 
-    int index = handleToDriver(handle);
-    if (index < 0)
-        return index;
+    const struct sensor_t* sensor = handleToSensor(handle);
+    if (!sensor)
+        return -EINVAL;
 
-    int err =  mSensors[index]->enable(handle, enabled);
-    if (!err) {
-        const char wakeMessage(WAKE_MESSAGE);
-        int result = write(mWritePipeFd, &wakeMessage, 1);
-        ALOGE_IF(result < 0,
-                "error sending wake message (%s)", strerror(errno));
-    }
+    // Sensors without a FIFO only support continuous reporting
+    if (!sensor->fifoMaxEventCount)
+        timeout = 0;
+
+    int err = setDelay(handle, period_ns);
+    if (err)
+        return err;
+
+    pthread_mutex_lock(&mBatchLock);
+    mBatchLatency[handle] = timeout;
+    pthread_mutex_unlock(&mBatchLock);
+
+    // The poll timeout depends on the latency, recompute it
+    wakePoll();
 
     ALOGV("%s-", __PRETTY_FUNCTION__);
 
-    return err;
+    return 0;
 }
 
-int sensors_poll_context_t::setDelay(int handle, int64_t ns)
+int sensors_poll_context_t::flush(int handle)
 {
     ALOGV("%s+: %d", __PRETTY_FUNCTION__, handle);
 
-    int index = handleToDriver(handle);
-    if (index < 0)
-        return index;
+    // only the sensors the framework activated can be flushed
+    if (!handleToSensor(handle) ||
+            !(android_atomic_acquire_load(&mActive) & HANDLE_BIT(handle)))
+        return -EINVAL;
+
+    pthread_mutex_lock(&mBatchLock);
+    mFlushPending[handle]++;
+    pthread_mutex_unlock(&mBatchLock);
+
+    wakePoll();
 
     ALOGV("%s-", __PRETTY_FUNCTION__);
 
-    return mSensors[index]->setDelay(handle, ns);
+    return 0;
+}
+
+void sensors_poll_context_t::queueEvent(const sensors_event_t& event)
+{
+    SensorEventFifo* const fifo(mFifo[event.sensor]);
+    const int handle = event.sensor;
+
+    pthread_mutex_lock(&mBatchLock);
+
+    // the driver may be running faster for another user of it, only keep
+    // the samples due at this handle's own period. The due time moves by
+    // whole periods so that the early samples the slack lets through do
+    // not add up, it starts over from the sample when a period was missed.
+    int64_t period = mEventPeriod[handle];
+    if (period && mLastEvent[handle]) {
+        if (event.timestamp - mLastEvent[handle] < period - period / DECIMATION_SLACK) {
+            pthread_mutex_unlock(&mBatchLock);
+            SensorStats::count(handle, SensorStats::EVENTS_DECIMATED);
+            return;
+        }
+        mLastEvent[handle] += period;
+        if (event.timestamp - mLastEvent[handle] >= period)
+            mLastEvent[handle] = event.timestamp;
+    } else {
+        mLastEvent[handle] = event.timestamp;
+    }
+
+    if (fifo->empty())
+        mBatchDeadline[handle] = now() + mBatchLatency[handle];
+
+    pthread_mutex_unlock(&mBatchLock);
+
+    if (!fifo->push(event)) {
+        SensorStats::count(handle, SensorStats::FIFO_OVERRUNS);
+        ALOGW_IF(!(mOverrunHandles & HANDLE_BIT(handle)),
+                "event FIFO overrun for handle %d", handle);
+        mOverrunHandles |= HANDLE_BIT(handle);
+    } else {
+        mOverrunHandles &= ~HANDLE_BIT(handle);
+    }
+}
+
+void sensors_poll_context_t::queueFused(int handle, int64_t timestamp)
+{
+    sensors_event_t event;
+    bool valid = false;
+
+    memset(&event, 0, sizeof(event));
+    event.version = sizeof(sensors_event_t);
+    event.sensor = handle;
+    event.timestamp = timestamp;
+
+    switch (handle) {
+        case ID_RV:
+            event.type = SENSOR_TYPE_ROTATION_VECTOR;
+            valid = mFusion.getRotationVector(event.data);
+            break;
+        case ID_GMRV:
+            event.type = SENSOR_TYPE_GEOMAGNETIC_ROTATION_VECTOR;
+            valid = mFusion.getRotationVector(event.data);
+            break;
+#ifdef SENSORS_HAL_ORIENTATION
+        case ID_O:
+            event.type = SENSOR_TYPE_ORIENTATION;
+            valid = mFusion.getOrientation(event.data);
+            break;
+#endif
+        case ID_GRV:
+            event.type = SENSOR_TYPE_GAME_ROTATION_VECTOR;
+            valid = mFusion.getGameRotationVector(event.data);
+            break;
+        case ID_GRAV:
+            event.type = SENSOR_TYPE_GRAVITY;
+            valid = mFusion.getGravity(event.data);
+            event.acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
+            break;
+        case ID_LA:
+            event.type = SENSOR_TYPE_LINEAR_ACCELERATION;
+            valid = mFusion.getLinearAcceleration(event.data);
+            event.acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
+            break;
+    }
+
+    if (valid)
+        queueEvent(event);
+}
+
+/*
+ * Report the settled rotation, data[0] holding its quarter turns
+ */
+void sensors_poll_context_t::queueRotation(int64_t timestamp)
+{
+    sensors_event_t event;
+
+    memset(&event, 0, sizeof(event));
+    event.version = sizeof(sensors_event_t);
+    event.sensor = ID_DO;
+    event.type = SENSOR_TYPE_DEVICE_ORIENTATION;
+    event.timestamp = timestamp;
+    event.data[0] = mDeviceOrientation.getRotation();
+
+    queueEvent(event);
+}
+
+/*
+ * Route a decoded event: the accelerometer and magnetometer feed the
+ * fusion, which runs once per sample whatever the number of virtual
+ * sensor users, and only handles the framework activated are queued.
+ */
+void sensors_poll_context_t::dispatch(const sensors_event_t& event)
+{
+    uint32_t active = android_atomic_acquire_load(&mActive);
+
+    // direct channels get the raw samples without going through poll
+    if (android_atomic_acquire_load(&mDirectHandles) & HANDLE_BIT(event.sensor)) {
+        pthread_mutex_lock(&mDirectLock);
+        for (int i = 0; i < MAX_DIRECT_CHANNELS; i++) {
+            if (mDirectChannels[i])
+                mDirectChannels[i]->write(event, event.sensor);
+        }
+        pthread_mutex_unlock(&mDirectLock);
+    }
+
+    if (event.sensor == ID_M) {
+        mFusion.handleMagnetic(event.magnetic, event.timestamp);
+    } else if (event.sensor == ID_A) {
+        mFusion.handleAcceleration(event.acceleration, event.timestamp);
+
+        static const int fused[] = {
+#ifdef SENSORS_HAL_ORIENTATION
+            ID_O,
+#endif
+            ID_RV, ID_GRV, ID_GRAV, ID_LA, ID_GMRV,
+        };
+        for (size_t i = 0; i < ARRAY_SIZE(fused); i++) {
+            if (active & HANDLE_BIT(fused[i]))
+                queueFused(fused[i], event.timestamp);
+        }
+
+        // the device orientation only reports when the rotation changes
+        if (android_atomic_acquire_load(&mRotationReset) &&
+                android_atomic_and(0, &mRotationReset))
+            mDeviceOrientation.reset();
+        if ((active & HANDLE_BIT(ID_DO)) &&
+                mDeviceOrientation.handleAcceleration(event.acceleration, event.timestamp))
+            queueRotation(event.timestamp);
+    }
+
+    if (active & HANDLE_BIT(event.sensor))
+        queueEvent(event);
+}
+
+/*
+ * Deliver the queued events that are due. When they do not all fit,
+ * wake-up sensors are served first and the remaining space is shared
+ * evenly among the other sensors, so a fast stream cannot starve a slow
+ * one. The selected events are then merged in timestamp order.
+ */
+int sensors_poll_context_t::drainFifos(sensors_event_t* data, int count,
+        int64_t now)
+{
+    int take[ID_MAX];
+    int nbEvents = 0;
+
+    pthread_mutex_lock(&mBatchLock);
+
+    // deliver the whole FIFO once the oldest event is due, it is full or
+    // the framework asked for a flush
+    int wanted = 0;
+    for (int i = 0; i < ID_MAX; i++) {
+        SensorEventFifo* const fifo(mFifo[i]);
+        take[i] = 0;
+        if (fifo && !fifo->empty() && (fifo->full() || mFlushPending[i] ||
+                mBatchLatency[i] == 0 || now >= mBatchDeadline[i])) {
+            take[i] = fifo->size();
+            wanted += take[i];
+        }
+    }
+
+    if (wanted > count) {
+        uint32_t settled = 0;
+        int left = count;
+        int sharing = 0;
+
+        for (int i = 0; i < ID_MAX; i++) {
+            if (!take[i])
+                continue;
+            if (mWakeUpHandles & HANDLE_BIT(i)) {
+                take[i] = take[i] < left ? take[i] : left;
+                left -= take[i];
+                settled |= HANDLE_BIT(i);
+            } else {
+                sharing++;
+            }
+        }
+
+        // water-fill: sensors wanting less than an even share get all
+        // of their events and leave the rest to the others
+        while (sharing) {
+            int share = left / sharing;
+            int smallest = -1;
+
+            for (int i = 0; i < ID_MAX; i++) {
+                if (take[i] && !(settled & HANDLE_BIT(i)) &&
+                        (smallest < 0 || take[i] < take[smallest]))
+                    smallest = i;
+            }
+
+            if (take[smallest] <= share) {
+                left -= take[smallest];
+                settled |= HANDLE_BIT(smallest);
+                sharing--;
+                continue;
+            }
+
+            // all the others want more, cap them to the share
+            int extra = left - share * sharing;
+            for (int i = 0; i < ID_MAX; i++) {
+                if (take[i] && !(settled & HANDLE_BIT(i)))
+                    take[i] = share + (extra-- > 0 ? 1 : 0);
+            }
+            break;
+        }
+    }
+
+    // merge the selected events, oldest first
+    while (count) {
+        int oldest = -1;
+        for (int i = 0; i < ID_MAX; i++) {
+            if (take[i] && (oldest < 0 ||
+                    mFifo[i]->front().timestamp < mFifo[oldest]->front().timestamp))
+                oldest = i;
+        }
+        if (oldest < 0)
+            break;
+
+        mFifo[oldest]->pop(data, 1);
+        take[oldest]--;
+        count--;
+        nbEvents++;
+        data++;
+    }
+
+    // flush complete is only reported once the FIFO was emptied
+    for (int i = 0; count && i < ID_MAX; i++) {
+        while (count && mFlushPending[i] && mFifo[i]->empty()) {
+            memset(data, 0, sizeof(sensors_meta_data_event_t));
+            data->version = META_DATA_VERSION;
+            data->type = SENSOR_TYPE_META_DATA;
+            data->meta_data.what = META_DATA_FLUSH_COMPLETE;
+            data->meta_data.sensor = i;
+            mFlushPending[i]--;
+            count--;
+            nbEvents++;
+            data++;
+        }
+    }
+
+    pthread_mutex_unlock(&mBatchLock);
+
+    return nbEvents;
+}
+
+int sensors_poll_context_t::nextBatchTimeout(int64_t now)
+{
+    int64_t timeout = -1;
+
+    pthread_mutex_lock(&mBatchLock);
+    for (int i = 0; i < ID_MAX; i++) {
+        if (mFlushPending[i]) {
+            timeout = 0;
+            break;
+        }
+
+        if (!mFifo[i] || mFifo[i]->empty())
+            continue;
+
+        int64_t left = mBatchDeadline[i] - now;
+        if (mFifo[i]->full() || mBatchLatency[i] == 0 || left <= 0) {
+            timeout = 0;
+            break;
+        }
+        if (timeout < 0 || left < timeout)
+            timeout = left;
+    }
+    pthread_mutex_unlock(&mBatchLock);
+
+    // round up to the next millisecond so that we don't wake up early
+    return timeout < 0 ? -1 : int((timeout + 999999) / 1000000);
 }
 
 int sensors_poll_context_t::pollEvents(sensors_event_t *data, int count)
 {
+    struct epoll_event events[numFds];
+    sensors_event_t* const first = data;
     int nbEvents = 0;
     int n = 0;
 
     ALOGV("%s+: %d", __PRETTY_FUNCTION__, count);
 
     do {
-        // see if we have some leftover from the last poll()
-        for (int i = 0; count && i < numSensorDrivers; i++) {
-            SensorBase* const sensor(mSensors[i]);
-            if (mSensors[i] && (mPollFds[i].revents & POLLIN || sensor->hasPendingEvents())) {
-                int nb = sensor->readEvents(data, count);
-                if (nb < count) {
+        applyDriverChanges();
+
+        // only service the drivers that fired or have leftovers, wake-up
+        // ones first. Everything goes through the queues, which are then
+        // drained together in timestamp order.
+        const uint32_t passes[] = { mReady & mWakeUpDrivers, mReady & ~mWakeUpDrivers };
+        for (size_t pass = 0; pass < ARRAY_SIZE(passes); pass++) {
+            for (uint32_t ready = passes[pass]; ready; ready &= ready - 1) {
+                int i = __builtin_ctz(ready);
+                SensorBase* const sensor(mSensors[i]);
+
+                int nb = sensor->readEvents(mScratch, ARRAY_SIZE(mScratch));
+                if (nb < (int) ARRAY_SIZE(mScratch) && !sensor->hasPendingEvents()) {
                     // no more data for this sensor
-                    mPollFds[i].revents = 0;
+                    mReady &= ~(1 << i);
                 }
-                count -= nb;
-                nbEvents += nb;
-                data += nb;
+
+                for (int j = 0; j < nb; j++)
+                    dispatch(mScratch[j]);
             }
         }
+
+        int nb = drainFifos(data, count, now());
+        count -= nb;
+        nbEvents += nb;
+        data += nb;
+
         if (count) {
+            int timeout = nbEvents || mReady ? 0 : nextBatchTimeout(now());
             do {
-                n = poll(mPollFds, numFds, nbEvents ? 0 : -1);
+                n = epoll_wait(mEpollFd, events, numFds, timeout);
             } while (n < 0 && errno == EINTR);
             if (n < 0) {
-                ALOGE("poll() failed (%s)", strerror(errno));
+                ALOGE("epoll_wait() failed (%s)", strerror(errno));
                 return -errno;
             }
-            if (mPollFds[wake].revents & POLLIN) {
-                char msg;
-                int result = read(mPollFds[wake].fd, &msg, 1);
-                ALOGE_IF(result < 0, "error reading from wake pipe (%s)", strerror(errno));
-                ALOGE_IF(msg != WAKE_MESSAGE, "unknown message on wake queue (0x%02x)", int(msg));
-                mPollFds[wake].revents = 0;
+            for (int j = 0; j < n; j++) {
+                if (events[j].data.ptr == NULL) {
+                    uint64_t msg;
+                    int result = read(mWakeFd, &msg, sizeof(msg));
+                    ALOGE_IF(result < 0, "error reading from wake eventfd (%s)", strerror(errno));
+                    continue;
+                }
+                SensorBase** const slot =
+                        static_cast<SensorBase**>(events[j].data.ptr);
+                mReady |= 1 << (slot - mSensors);
             }
+            // a batch deadline expired or a driver has leftovers
+            if (n == 0 && (!nbEvents || mReady))
+                n = 1;
         }
         // if we have events and space, go read them
     } while (n && count);
 
+    int64_t t = now();
+    uint32_t awaiting = android_atomic_acquire_load(&mAwaitingSample);
+    for (int i = 0; i < nbEvents; i++) {
+        const int handle = first[i].sensor;
+
+        SensorStats::delivered(first[i], t);
+        if (first[i].type != SENSOR_TYPE_META_DATA && (awaiting & HANDLE_BIT(handle))) {
+            awaiting &= ~HANDLE_BIT(handle);
+            android_atomic_and(~HANDLE_BIT(handle), &mAwaitingSample);
+            SensorStats::startup(handle, t - mEnableTime[handle]);
+        }
+    }
+    checkStats(t);
+
     ALOGV("%s-", __PRETTY_FUNCTION__);
 
     return nbEvents;
 }
 
+/*
+ * Write the statistics when asked to through the properties, called by
+ * the poll thread
+ */
+void sensors_poll_context_t::checkStats(int64_t now)
+{
+    if (now < mNextStatsCheck)
+        return;
+    mNextStatsCheck = now + STATS_CHECK_INTERVAL_NS;
+
+    char value[PROPERTY_VALUE_MAX];
+    bool write = false;
+
+    property_get(STATS_DUMP_PROPERTY, value, "");
+    if (strcmp(value, mStatsDump)) {
+        strcpy(mStatsDump, value);
+        write = true;
+    }
+
+    int64_t interval = property_get_int64(STATS_INTERVAL_PROPERTY, 0) * 1000000000LL;
+    if (interval > 0 && now >= mNextStatsWrite)
+        write = true;
+
+    if (write) {
+        int err = SensorStats::writeFile(SENSORS_STATS_FILE);
+        ALOGE_IF(err < 0, "unable to write %s (%s)", SENSORS_STATS_FILE, strerror(-err));
+        mNextStatsWrite = now + interval;
+    }
+}
+
 static int poll__close(struct hw_device_t *dev)
 {
     sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
@@ -464,6 +1556,68 @@ static int poll__poll(struct sensors_poll_device_t *dev,
     return ctx->pollEvents(data, count);
 }
 
+static int poll__batch(struct sensors_poll_device_1 *dev,
+                       int handle, int flags, int64_t period_ns, int64_t timeout)
+{
+    ALOGV("%s", __PRETTY_FUNCTION__);
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+    return ctx->batch(handle, flags, period_ns, timeout);
+}
+
+static int poll__flush(struct sensors_poll_device_1 *dev,
+                       int handle)
+{
+    ALOGV("%s", __PRETTY_FUNCTION__);
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+    return ctx->flush(handle);
+}
+
+#ifdef SENSORS_DEVICE_API_VERSION_1_4
+static int poll__register_direct_channel(struct sensors_poll_device_1 *dev,
+                                         const struct sensors_direct_mem_t* mem,
+                                         int channel_handle)
+{
+    ALOGV("%s", __PRETTY_FUNCTION__);
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+
+    if (mem == NULL)
+        return ctx->unregisterDirectChannel(channel_handle);
+
+    if (mem->type != SENSOR_DIRECT_MEM_TYPE_ASHMEM ||
+            mem->format != SENSOR_DIRECT_FMT_SENSORS_EVENT ||
+            mem->handle == NULL || mem->handle->numFds < 1)
+        return -EINVAL;
+
+    return ctx->registerDirectChannel(mem->handle->data[0], mem->size);
+}
+
+static int poll__config_direct_report(struct sensors_poll_device_1 *dev,
+                                      int sensor_handle, int channel_handle,
+                                      const struct sensors_direct_cfg_t *config)
+{
+    // nominal period of the stop, normal, fast and very fast rate levels
+    static const int64_t ratePeriods[] = { 0, 20000000, 5000000, 1250000 };
+
+    ALOGV("%s", __PRETTY_FUNCTION__);
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+
+    if (config == NULL || config->rate_level < 0 ||
+            config->rate_level > SENSOR_DIRECT_RATE_FAST)
+        return -EINVAL;
+
+    // refuse the levels above the one the sensor advertises
+    if (config->rate_level != SENSOR_DIRECT_RATE_STOP) {
+        const struct sensor_t* sensor = handleToSensor(sensor_handle);
+        if (!sensor || config->rate_level > (int) ((sensor->flags &
+                SENSOR_FLAG_MASK_DIRECT_REPORT) >> SENSOR_FLAG_SHIFT_DIRECT_REPORT))
+            return -EINVAL;
+    }
+
+    return ctx->configDirectReport(sensor_handle, channel_handle,
+            ratePeriods[config->rate_level]);
+}
+#endif
+
 static int open_sensors(const struct hw_module_t* module,
                         const char* id __unused,
                         struct hw_device_t** device)
@@ -472,15 +1626,25 @@ static int open_sensors(const struct hw_module_t* module,
     int status = -EINVAL;
     sensors_poll_context_t *dev = new sensors_poll_context_t();
 
-    memset(&dev->device, 0, sizeof(sensors_poll_device_t));
+    memset(&dev->device, 0, sizeof(sensors_poll_device_1));
 
     dev->device.common.tag      = HARDWARE_DEVICE_TAG;
-    dev->device.common.version  = SENSORS_DEVICE_API_VERSION_1_0;
+#ifdef SENSORS_DEVICE_API_VERSION_1_4
+    dev->device.common.version  = SENSORS_DEVICE_API_VERSION_1_4;
+#else
+    dev->device.common.version  = SENSORS_DEVICE_API_VERSION_1_3;
+#endif
     dev->device.common.module   = const_cast<hw_module_t*>(module);
     dev->device.common.close    = poll__close;
     dev->device.activate        = poll__activate;
     dev->device.setDelay        = poll__setDelay;
     dev->device.poll            = poll__poll;
+    dev->device.batch           = poll__batch;
+    dev->device.flush           = poll__flush;
+#ifdef SENSORS_DEVICE_API_VERSION_1_4
+    dev->device.register_direct_channel = poll__register_direct_channel;
+    dev->device.config_direct_report = poll__config_direct_report;
+#endif
 
     *device = &dev->device.common;
     status = 0;
@@ -42,6 +42,13 @@ enum {
     ID_O,
     ID_L,
     ID_PX,
+    ID_RV,
+    ID_GRV,
+    ID_GRAV,
+    ID_LA,
+    ID_GMRV,
+    ID_DO,
+    ID_MAX, // one past the last handle
 };
 
 enum {
@@ -50,7 +57,12 @@ enum {
 	SENSOR_TYPE_GP2A,
 };
 
+#ifndef DEVICE_VARIANT_SYSFS
 #define DEVICE_VARIANT_SYSFS "/sys/board/type"
+#endif
+
+/* Samples closer than period - period / DECIMATION_SLACK are dropped */
+#define DECIMATION_SLACK (8)
 
 #define EVENT_TYPE_PROXIMITY        ABS_DISTANCE
 #define EVENT_TYPE_LIGHT            REL_MISC
@@ -0,0 +1,700 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Record/replay harness for the sensors HAL.
+ *
+ *   sensorsbench record <file> [seconds] [-c]
+ *     On the tablet: records the raw evdev streams of the sensor input
+ *     devices that SensorBase::openInput looks up by name. -c writes the
+ *     compact SensorTrace format, which the HAL also writes when
+ *     persist.sensors.trace is set; replay takes both.
+ *
+ *   sensorsbench replay <file> [-f] [-v variant]
+ *     On a Linux workstation (root, /dev/uinput): recreates the devices
+ *     through uinput, feeds the recording to the HAL compiled into this
+ *     binary and reports throughput, poll thread CPU cost per event and
+ *     input-to-delivery latency percentiles, followed by the HAL's own
+ *     counters and histograms. -f replays as fast as
+ *     possible instead of with the recorded timing, -v selects the board
+ *     variant the HAL sees (espresso, espressowifi, espresso10).
+ *
+ *   sensorsbench simulate [seconds] [-v variant]
+ *     Anywhere: runs the HAL on the simulated devices of SimulatedBackend,
+ *     as set by SENSORS_SIM, and reports the same figures as replay. For
+ *     a load test, raise the device rates, e.g.
+ *     SENSORS_SIM=accelerometer=shake@4000,geomagnetic=rotation@2000
+ *
+ * The host build points the HAL sysfs paths to SENSORSBENCH_ROOT, see
+ * Android.mk, where the fake enable/delay attributes are created.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <hardware/sensors.h>
+
+#include "sensors.h"
+#include "input_index.h"
+#include "SensorStats.h"
+#include "SensorTrace.h"
+
+#ifndef SENSORSBENCH_ROOT
+#define SENSORSBENCH_ROOT "/tmp/sensorsbench"
+#endif
+
+extern struct sensors_module_t HAL_MODULE_INFO_SYM;
+
+/*****************************************************************************/
+
+struct bench_device {
+    const char* name;
+    int handle;
+    int type;
+    int codes[3];
+    int numCodes;
+};
+
+static const struct bench_device sBenchDevices[] = {
+    { "accelerometer", ID_A, EV_ABS, { ABS_X, ABS_Y, ABS_Z }, 3 },
+    { "geomagnetic", ID_M, EV_ABS, { ABS_X, ABS_Y, ABS_Z }, 3 },
+    { "orientation", ID_O, EV_ABS, { ABS_X, ABS_Y, ABS_Z }, 3 },
+    { "light_sensor", ID_L, EV_REL, { EVENT_TYPE_LIGHT }, 1 },
+    { "proximity_sensor", ID_PX, EV_ABS, { EVENT_TYPE_PROXIMITY }, 1 },
+};
+
+#define NUM_BENCH_DEVICES ARRAY_SIZE(sBenchDevices)
+
+#define BENCH_MAGIC "SNSBENCH"
+
+/*
+ * One recorded input event. The layout doesn't depend on the size of
+ * struct timeval so that target recordings replay on 64-bit hosts.
+ */
+struct bench_record {
+    int64_t time;       // us
+    int32_t value;
+    uint16_t type;
+    uint16_t code;
+    uint32_t device;
+    uint32_t reserved;
+};
+
+static volatile sig_atomic_t sStop;
+
+static void onSignal(int sig __unused)
+{
+    sStop = 1;
+}
+
+static int64_t clockNs(clockid_t clock)
+{
+    struct timespec t;
+    clock_gettime(clock, &t);
+    return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+}
+
+// The clock of the HAL event timestamps
+static int64_t sensorClockNs()
+{
+    return clockNs(CLOCK_BOOTTIME);
+}
+
+static int openInputByName(const char* inputName, char* node, size_t size)
+{
+    DIR* dir = opendir("/dev/input");
+    struct dirent* de;
+    int fd = -1;
+
+    if (dir == NULL)
+        return -1;
+
+    while ((de = readdir(dir))) {
+        char path[PATH_MAX];
+        char name[80];
+
+        if (strncmp(de->d_name, "event", 5))
+            continue;
+
+        snprintf(path, sizeof(path), "/dev/input/%s", de->d_name);
+        fd = open(path, O_RDONLY | O_NONBLOCK);
+        if (fd < 0)
+            continue;
+
+        if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) < 1)
+            name[0] = '\0';
+        if (!strcmp(name, inputName)) {
+            if (node)
+                snprintf(node, size, "%s", de->d_name);
+            break;
+        }
+
+        close(fd);
+        fd = -1;
+    }
+    closedir(dir);
+
+    return fd;
+}
+
+/*****************************************************************************/
+
+static int record(const char* path, int seconds, bool compact)
+{
+    struct pollfd fds[NUM_BENCH_DEVICES];
+    size_t devices[NUM_BENCH_DEVICES];
+    int traceDevices[NUM_BENCH_DEVICES];
+    size_t numFds = 0;
+    size_t numRecords = 0;
+    SensorTraceWriter trace;
+    FILE* f = NULL;
+
+    for (size_t i = 0; i < NUM_BENCH_DEVICES; i++) {
+        int fd = openInputByName(sBenchDevices[i].name, NULL, 0);
+        if (fd < 0) {
+            fprintf(stderr, "%s: not found, skipping\n", sBenchDevices[i].name);
+            continue;
+        }
+        fds[numFds].fd = fd;
+        fds[numFds].events = POLLIN;
+        devices[numFds] = i;
+        numFds++;
+    }
+
+    if (!numFds) {
+        fprintf(stderr, "no sensor input device found\n");
+        return 1;
+    }
+
+    if (compact) {
+        if (trace.open(path) < 0) {
+            fprintf(stderr, "cannot open %s\n", path);
+            return 1;
+        }
+        for (size_t i = 0; i < numFds; i++)
+            traceDevices[i] = trace.addDevice(sBenchDevices[devices[i]].name);
+    } else {
+        f = fopen(path, "wb");
+        if (f == NULL) {
+            fprintf(stderr, "cannot open %s (%s)\n", path, strerror(errno));
+            return 1;
+        }
+        fwrite(BENCH_MAGIC, 1, 8, f);
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    int64_t end = seconds > 0 ? clockNs(CLOCK_MONOTONIC) + seconds * 1000000000LL : 0;
+
+    while (!sStop && (!end || clockNs(CLOCK_MONOTONIC) < end)) {
+        int n = poll(fds, numFds, 100);
+        if (n < 0 && errno != EINTR)
+            break;
+
+        for (size_t i = 0; n > 0 && i < numFds; i++) {
+            struct input_event events[64];
+
+            if (!(fds[i].revents & POLLIN))
+                continue;
+
+            ssize_t nread = read(fds[i].fd, events, sizeof(events));
+            if (compact && nread > 0) {
+                trace.write(traceDevices[i], events, nread / sizeof(events[0]));
+                numRecords += nread / sizeof(events[0]);
+                continue;
+            }
+
+            for (ssize_t j = 0; j < nread / (ssize_t) sizeof(events[0]); j++) {
+                struct bench_record r;
+                memset(&r, 0, sizeof(r));
+                r.time = events[j].time.tv_sec * 1000000LL + events[j].time.tv_usec;
+                r.value = events[j].value;
+                r.type = events[j].type;
+                r.code = events[j].code;
+                r.device = devices[i];
+                fwrite(&r, sizeof(r), 1, f);
+                numRecords++;
+            }
+        }
+    }
+
+    if (compact)
+        trace.close();
+    else
+        fclose(f);
+    for (size_t i = 0; i < numFds; i++)
+        close(fds[i].fd);
+
+    struct stat st;
+    if (stat(path, &st) < 0)
+        st.st_size = 0;
+    printf("recorded %zu events to %s, %lld bytes, %.1f%% of raw evdev\n",
+            numRecords, path, (long long) st.st_size,
+            numRecords ? 100.0 * st.st_size / (numRecords * sizeof(input_event)) : 0.0);
+
+    return 0;
+}
+
+/*****************************************************************************/
+
+struct replay_context {
+    std::vector<bench_record> records;
+    int uinputFds[NUM_BENCH_DEVICES];
+    bool fast;
+    int seconds;                // simulate only
+
+    sensors_poll_device_1_t* device;
+    volatile int replayDone;
+
+    int64_t replayStart;
+    int64_t replayEnd;
+    int64_t pollCpu;
+    size_t delivered[NUM_BENCH_DEVICES];
+    std::vector<int64_t> latencies;
+};
+
+static int createUinput(const struct bench_device* device)
+{
+    struct uinput_user_dev dev;
+    int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if (fd < 0)
+        return -1;
+
+    memset(&dev, 0, sizeof(dev));
+    snprintf(dev.name, UINPUT_MAX_NAME_SIZE, "%s", device->name);
+    dev.id.bustype = BUS_VIRTUAL;
+
+    ioctl(fd, UI_SET_EVBIT, EV_SYN);
+    ioctl(fd, UI_SET_EVBIT, device->type);
+    for (int i = 0; i < device->numCodes; i++) {
+        if (device->type == EV_ABS) {
+            ioctl(fd, UI_SET_ABSBIT, device->codes[i]);
+            dev.absmin[device->codes[i]] = -2147483647;
+            dev.absmax[device->codes[i]] = 2147483647;
+        } else {
+            ioctl(fd, UI_SET_RELBIT, device->codes[i]);
+        }
+    }
+
+    if (write(fd, &dev, sizeof(dev)) != sizeof(dev) ||
+            ioctl(fd, UI_DEV_CREATE) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int writeFile(const char* path, const char* value)
+{
+    FILE* f = fopen(path, "w");
+    if (f == NULL)
+        return -1;
+    fputs(value, f);
+    fclose(f);
+    return 0;
+}
+
+// The HAL looks input devices up by their sysfs name and expects the
+// enable/delay attributes next to it
+static int createFakeSysfs(const char* variant)
+{
+    char path[PATH_MAX];
+
+    mkdir(SENSORSBENCH_ROOT, 0755);
+    mkdir(SENSORSBENCH_ROOT "/sysfs", 0755);
+
+    if (writeFile(DEVICE_VARIANT_SYSFS, variant) < 0)
+        return -1;
+
+    for (size_t i = 0; i < NUM_BENCH_DEVICES; i++) {
+        char node[32];
+        int fd = openInputByName(sBenchDevices[i].name, node, sizeof(node));
+        if (fd < 0)
+            return -1;
+        close(fd);
+
+        snprintf(path, sizeof(path), INPUT_SYSFS_PATH "%s", node);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), INPUT_SYSFS_PATH "%s/device", node);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), INPUT_SYSFS_PATH "%s/device/name", node);
+        writeFile(path, sBenchDevices[i].name);
+
+        static const char* const attrs[] = { "enable", "delay", "poll_delay" };
+        for (size_t j = 0; j < ARRAY_SIZE(attrs); j++) {
+            snprintf(path, sizeof(path), INPUT_SYSFS_PATH "%s/device/%s", node, attrs[j]);
+            writeFile(path, "0");
+        }
+    }
+
+    return 0;
+}
+
+static int loadTrace(const char* path, std::vector<bench_record>& records)
+{
+    SensorTraceReader trace;
+    struct input_event events[SENSOR_TRACE_MAX_FRAME + 1];
+    const char* name;
+    int n;
+
+    if (trace.open(path) < 0)
+        return -1;
+
+    while ((n = trace.next(&name, events, ARRAY_SIZE(events))) > 0) {
+        size_t device = 0;
+        while (device < NUM_BENCH_DEVICES && strcmp(sBenchDevices[device].name, name))
+            device++;
+        if (device == NUM_BENCH_DEVICES)
+            continue;
+
+        for (int i = 0; i < n; i++) {
+            bench_record r;
+            memset(&r, 0, sizeof(r));
+            r.time = events[i].time.tv_sec * 1000000LL + events[i].time.tv_usec;
+            r.value = events[i].value;
+            r.type = events[i].type;
+            r.code = events[i].code;
+            r.device = device;
+            records.push_back(r);
+        }
+    }
+
+    return n < 0 ? -1 : 0;
+}
+
+static int loadRecording(const char* path, std::vector<bench_record>& records)
+{
+    char magic[8];
+    bench_record r;
+
+    if (SensorTraceReader::probe(path))
+        return loadTrace(path, records);
+
+    FILE* f = fopen(path, "rb");
+    if (f == NULL)
+        return -1;
+
+    if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+            memcmp(magic, BENCH_MAGIC, sizeof(magic))) {
+        fclose(f);
+        return -1;
+    }
+
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        if (r.device < NUM_BENCH_DEVICES)
+            records.push_back(r);
+    }
+    fclose(f);
+
+    return 0;
+}
+
+static void* replayThread(void* arg)
+{
+    replay_context* ctx = static_cast<replay_context*>(arg);
+    int64_t base = ctx->records.empty() ? 0 : ctx->records[0].time;
+
+    ctx->replayStart = clockNs(CLOCK_MONOTONIC);
+
+    for (size_t i = 0; i < ctx->records.size() && !sStop; i++) {
+        const bench_record& r = ctx->records[i];
+        struct input_event event;
+
+        if (!ctx->fast) {
+            int64_t due = ctx->replayStart + (r.time - base) * 1000;
+            struct timespec t;
+            t.tv_sec = due / 1000000000LL;
+            t.tv_nsec = due % 1000000000LL;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+        }
+
+        memset(&event, 0, sizeof(event));
+        event.type = r.type;
+        event.code = r.code;
+        event.value = r.value;
+        write(ctx->uinputFds[r.device], &event, sizeof(event));
+    }
+
+    ctx->replayEnd = clockNs(CLOCK_MONOTONIC);
+    ctx->replayDone = 1;
+
+    // let the poll thread see the end of the stream
+    for (size_t i = 0; i < NUM_BENCH_DEVICES; i++)
+        ctx->device->flush(ctx->device, sBenchDevices[i].handle);
+
+    return NULL;
+}
+
+static void* pollThread(void* arg)
+{
+    replay_context* ctx = static_cast<replay_context*>(arg);
+    sensors_event_t buffer[256];
+    int64_t cpuStart = clockNs(CLOCK_THREAD_CPUTIME_ID);
+
+    while (!sStop) {
+        int n = ctx->device->poll(&ctx->device->v0, buffer, ARRAY_SIZE(buffer));
+        int64_t now = sensorClockNs();
+        bool done = false;
+
+        for (int i = 0; i < n; i++) {
+            if (buffer[i].type == SENSOR_TYPE_META_DATA) {
+                done |= ctx->replayDone;
+                continue;
+            }
+
+            for (size_t j = 0; j < NUM_BENCH_DEVICES; j++) {
+                if (sBenchDevices[j].handle == buffer[i].sensor)
+                    ctx->delivered[j]++;
+            }
+            ctx->latencies.push_back(now - buffer[i].timestamp);
+        }
+
+        if (n < 0 || done)
+            break;
+    }
+
+    ctx->pollCpu = clockNs(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+
+    return NULL;
+}
+
+static int64_t percentile(std::vector<int64_t>& v, int p)
+{
+    if (v.empty())
+        return 0;
+
+    size_t k = (v.size() - 1) * p / 100;
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+// Runs the HAL with every sensor at its fastest rate while source feeds
+// it, then prints the results
+static int runHal(replay_context& ctx, void* (*source)(void*))
+{
+    struct hw_device_t* device;
+    pthread_t feeder, poller;
+
+    if (HAL_MODULE_INFO_SYM.common.methods->open(&HAL_MODULE_INFO_SYM.common,
+                SENSORS_HARDWARE_POLL, &device) < 0) {
+        fprintf(stderr, "cannot open the sensors HAL\n");
+        return 1;
+    }
+    ctx.device = (sensors_poll_device_1_t*) device;
+
+    struct sensor_t const* list;
+    int count = HAL_MODULE_INFO_SYM.get_sensors_list(&HAL_MODULE_INFO_SYM, &list);
+    for (int i = 0; i < count; i++) {
+        ctx.device->batch(ctx.device, list[i].handle, 0, list[i].minDelay * 1000LL, 0);
+        ctx.device->activate(&ctx.device->v0, list[i].handle, 1);
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    pthread_create(&poller, NULL, pollThread, &ctx);
+    pthread_create(&feeder, NULL, source, &ctx);
+    pthread_join(feeder, NULL);
+    pthread_join(poller, NULL);
+
+    for (int i = 0; i < count; i++)
+        ctx.device->activate(&ctx.device->v0, list[i].handle, 0);
+    device->close(device);
+
+    size_t total = ctx.latencies.size();
+    double seconds = (ctx.replayEnd - ctx.replayStart) / 1e9;
+
+    for (size_t i = 0; i < NUM_BENCH_DEVICES; i++)
+        printf("  %-18s %zu events\n", sBenchDevices[i].name, ctx.delivered[i]);
+    printf("delivered: %zu events, %.1f events/s\n", total,
+            seconds > 0 ? total / seconds : 0.0);
+    printf("poll thread cpu: %.3f ms, %.2f us/event\n", ctx.pollCpu / 1e6,
+            total ? ctx.pollCpu / 1e3 / total : 0.0);
+    printf("latency: p50 %.1f us, p99 %.1f us\n",
+            percentile(ctx.latencies, 50) / 1e3,
+            percentile(ctx.latencies, 99) / 1e3);
+    printf("HAL statistics:\n");
+    fflush(stdout);
+    SensorStats::dump(STDOUT_FILENO);
+
+    return 0;
+}
+
+static int replay(const char* path, bool fast, const char* variant)
+{
+    replay_context ctx;
+
+    ctx.fast = fast;
+    ctx.replayDone = 0;
+    memset(ctx.delivered, 0, sizeof(ctx.delivered));
+
+    if (loadRecording(path, ctx.records) < 0) {
+        fprintf(stderr, "cannot load recording %s\n", path);
+        return 1;
+    }
+
+    for (size_t i = 0; i < NUM_BENCH_DEVICES; i++) {
+        ctx.uinputFds[i] = createUinput(&sBenchDevices[i]);
+        if (ctx.uinputFds[i] < 0) {
+            fprintf(stderr, "cannot create uinput device %s (%s)\n",
+                    sBenchDevices[i].name, strerror(errno));
+            return 1;
+        }
+    }
+
+    // give udev some time to create the device nodes
+    usleep(500000);
+
+    if (createFakeSysfs(variant) < 0) {
+        fprintf(stderr, "cannot set up " SENSORSBENCH_ROOT "\n");
+        return 1;
+    }
+
+    printf("replaying %zu input events\n", ctx.records.size());
+    int ret = runHal(ctx, replayThread);
+
+    for (size_t i = 0; i < NUM_BENCH_DEVICES; i++) {
+        ioctl(ctx.uinputFds[i], UI_DEV_DESTROY);
+        close(ctx.uinputFds[i]);
+    }
+
+    return ret;
+}
+
+/*****************************************************************************/
+
+// The simulated devices run on their own, this only times the run
+static void* simulateThread(void* arg)
+{
+    replay_context* ctx = static_cast<replay_context*>(arg);
+    int64_t end;
+
+    ctx->replayStart = clockNs(CLOCK_MONOTONIC);
+    end = ctx->replayStart + ctx->seconds * 1000000000LL;
+
+    while (!sStop && clockNs(CLOCK_MONOTONIC) < end)
+        usleep(100000);
+
+    ctx->replayEnd = clockNs(CLOCK_MONOTONIC);
+    ctx->replayDone = 1;
+
+    for (size_t i = 0; i < NUM_BENCH_DEVICES; i++)
+        ctx->device->flush(ctx->device, sBenchDevices[i].handle);
+
+    return NULL;
+}
+
+static int simulate(int seconds, const char* variant)
+{
+    replay_context ctx;
+
+    ctx.seconds = seconds;
+    ctx.replayDone = 0;
+    memset(ctx.delivered, 0, sizeof(ctx.delivered));
+
+    // an explicit SENSORS_BACKEND is kept, the same run then works on
+    // the tablet's own devices
+    setenv("SENSORS_BACKEND", "sim", 0);
+
+    mkdir(SENSORSBENCH_ROOT, 0755);
+    if (writeFile(DEVICE_VARIANT_SYSFS, variant) < 0) {
+        fprintf(stderr, "cannot set up " SENSORSBENCH_ROOT "\n");
+        return 1;
+    }
+
+    printf("simulating for %d s, devices \"%s\"\n", seconds,
+            getenv("SENSORS_SIM") ? getenv("SENSORS_SIM") : "");
+    return runHal(ctx, simulateThread);
+}
+
+/*****************************************************************************/
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s record <file> [seconds] [-c]\n"
+            "       %s replay <file> [-f] [-v variant]\n"
+            "       %s simulate [seconds] [-v variant]\n", name, name, name);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 3 && !strcmp(argv[1], "record")) {
+        bool compact = false;
+        int seconds = 0;
+
+        for (int i = 3; i < argc; i++) {
+            if (!strcmp(argv[i], "-c"))
+                compact = true;
+            else
+                seconds = atoi(argv[i]);
+        }
+
+        return record(argv[2], seconds, compact);
+    }
+
+    if (argc >= 3 && !strcmp(argv[1], "replay")) {
+        const char* variant = "espresso";
+        bool fast = false;
+
+        for (int i = 3; i < argc; i++) {
+            if (!strcmp(argv[i], "-f"))
+                fast = true;
+            else if (!strcmp(argv[i], "-v") && i + 1 < argc)
+                variant = argv[++i];
+        }
+
+        return replay(argv[2], fast, variant);
+    }
+
+    if (argc >= 2 && !strcmp(argv[1], "simulate")) {
+        const char* variant = "espresso";
+        int seconds = 10;
+
+        for (int i = 2; i < argc; i++) {
+            if (!strcmp(argv[i], "-v") && i + 1 < argc)
+                variant = argv[++i];
+            else
+                seconds = atoi(argv[i]);
+        }
+
+        return simulate(seconds, variant);
+    }
+
+    usage(argv[0]);
+    return 1;
+}